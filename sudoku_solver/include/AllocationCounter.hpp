@@ -0,0 +1,30 @@
+#ifndef ALLOCATIONCOUNTER_HPP
+#define ALLOCATIONCOUNTER_HPP
+
+#include <cstddef>
+#include <opencv4/opencv2/core.hpp>
+
+using namespace std;
+
+/**
+ * Counts heap allocations, to check that steady-state frame processing does not allocate.
+ * cv::Mat buffers are counted once countMatAllocations() installed a counting allocator.
+ * Calls of the global operator new are only counted when the executable replaces it and calls
+ * countHeapAllocation() (SudokuBenchmark does with cmake -DSUDOKU_COUNT_ALLOCATIONS=ON); a
+ * library has no business replacing it for the whole process. Scratch buffers that OpenCV takes
+ * with cv::fastMalloc directly (cv::AutoBuffer) are not seen by either.
+ */
+class AllocationCounter{
+
+    public:
+        // every cv::Mat buffer allocated from now on is counted, calling it again does nothing
+        static void countMatAllocations();
+
+        static size_t matAllocations();
+        // for a replaced operator new, must not allocate itself
+        static void countHeapAllocation();
+        // always 0 unless operator new calls countHeapAllocation()
+        static size_t heapAllocations();
+};
+
+#endif
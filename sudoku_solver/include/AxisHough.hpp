@@ -0,0 +1,52 @@
+#ifndef AXISHOUGH_HPP
+#define AXISHOUGH_HPP
+
+#include <vector>
+#include <opencv4/opencv2/core.hpp>
+
+using namespace std;
+
+/**
+ * Standard Hough transform that only votes in the angle windows around 0 and 90 degrees.
+ * Lines are returned in the same (rho, theta) representation as cv::HoughLines, sorted by
+ * number of votes, so it can be used as a drop-in replacement when only (roughly)
+ * axis-aligned lines are of interest.
+ */
+class AxisHough{
+
+    public:
+        explicit AxisHough(double rho = 1, double theta = CV_PI/180, double angleWindowDeg = 5);
+
+        void setAngleWindow(double angleWindowDeg);
+        double getAngleWindow() const {return angleWindowDeg;};
+
+        // every non-zero pixel of the 8-bit single channel img is treated as an edge point
+        void detect(const cv::Mat& img, vector<cv::Vec2f>& lines, int threshold);
+
+    private:
+        double rhoStep;
+        double thetaStep;
+        double angleWindowDeg;
+
+        // one entry per accumulator row, rows with valid == false are zero padding between windows
+        struct AngleRow{
+            float theta;
+            float cosT;
+            float sinT;
+            bool valid;
+        };
+        vector<AngleRow> angleRows;
+
+        // scratch buffers, kept between calls
+        vector<float> pointsX;
+        vector<float> pointsY;
+        vector<int> accumulator;
+        vector<int> peaks;
+
+        void buildAngleTable();
+        void collectEdgePoints(const cv::Mat& img);
+        void vote(int numRho);
+        void suppressNonMaxima(int numRho, int threshold);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef BATCHPIPELINE_HPP
+#define BATCHPIPELINE_HPP
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv4/opencv2/core.hpp>
+
+#include "Sudoku.hpp"
+#include "ImgProc.hpp"
+#include "MnistModel.hpp"
+#include "CellReader.hpp"
+#include "BlockingQueue.hpp"
+
+using namespace std;
+
+struct BatchOptions{
+    // at least 1 each
+    int visionWorkers = 2;
+    int solverWorkers = 2;
+    Sudoku::Backend solverBackend = Sudoku::DFS;
+    // at most this many images have their digits classified in one forward pass
+    int recognitionBatch = 8;
+    // decode images at 1/decodeReduction of their resolution (1, 2, 4 or 8), cheap for JPEGs
+    int decodeReduction = 1;
+    // images in flight between two stages
+    size_t queueCapacity = 16;
+    ImgProcParams imgProcParams;
+};
+
+/**
+ * Processes many images in one process, with every stage on its own threads so that decoding
+ * overlaps with the vision, recognition and solving of the other images:
+ *
+ *   reader -> vision workers -> recognizer (batched) -> solver workers -> writer
+ *
+ * Each image results in one JSON line.
+ */
+class BatchPipeline{
+
+    public:
+        BatchPipeline(const BatchOptions& options, MnistModel& model);
+
+        // input is a directory of images or a manifest file with one image path per line; throws if
+        // it cannot be listed or the options have no workers
+        void run(const string& input, ostream& results);
+
+        static vector<string> listImages(const string& input);
+        // contents of a JSON string: quotes, backslashes and control characters escaped
+        static string jsonEscape(const string& text);
+
+    private:
+        struct Job{
+            size_t index = 0;
+            string path;
+            cv::Mat img;
+            string error;
+            CellReader::CellResults cells;
+            vector<cv::Mat> digits;
+            size_t nCandidates = 0;
+            vector<Sudoku> solved;
+        };
+        typedef unique_ptr<Job> JobPtr;
+
+        BatchOptions options;
+        MnistModel& model;
+
+        BlockingQueue<JobPtr> visionQueue;
+        BlockingQueue<JobPtr> recognitionQueue;
+        BlockingQueue<JobPtr> solverQueue;
+        BlockingQueue<JobPtr> writerQueue;
+
+        // time (in us) that each stage was busy, summed over its threads
+        atomic<long> readTime{0};
+        atomic<long> visionTime{0};
+        atomic<long> recognitionTime{0};
+        atomic<long> solverTime{0};
+
+        void readImages(const vector<string>& paths);
+        void processImages(atomic<int>& running);
+        void recognizeDigits();
+        void solveGames(atomic<int>& running);
+        void writeResults(ostream& results, size_t& nWritten, size_t& nSolved);
+
+        static string toJson(const Job& job);
+};
+
+#endif
\ No newline at end of file
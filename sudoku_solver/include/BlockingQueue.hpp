@@ -0,0 +1,76 @@
+#ifndef BLOCKINGQUEUE_HPP
+#define BLOCKINGQUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Bounded multi-producer multi-consumer queue. Producers block while it is full (or give up
+ * with tryPush), consumers while it is empty. Once closed, consumers drain what is left and then get false.
+ */
+template <typename T>
+class BlockingQueue{
+
+    public:
+        explicit BlockingQueue(size_t capacity): capacity(capacity) {};
+
+        void push(T item){
+            unique_lock<mutex> lock(mtx);
+            notFull.wait(lock, [this]{ return items.size() < capacity || closed; });
+            items.push_back(move(item));
+            notEmpty.notify_one();
+        }
+
+        // false, and item is dropped, if the queue is full or closed
+        bool tryPush(T item){
+            lock_guard<mutex> lock(mtx);
+            if(items.size() >= capacity || closed) return false;
+            items.push_back(move(item));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        bool pop(T& item){
+            unique_lock<mutex> lock(mtx);
+            notEmpty.wait(lock, [this]{ return !items.empty() || closed; });
+            if(items.empty()) return false;
+            item = move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        // waits for at least one item, then takes whatever else is available up to maxItems
+        bool popUpTo(vector<T>& out, size_t maxItems){
+            unique_lock<mutex> lock(mtx);
+            notEmpty.wait(lock, [this]{ return !items.empty() || closed; });
+            if(items.empty()) return false;
+            while(!items.empty() && out.size() < maxItems){
+                out.push_back(move(items.front()));
+                items.pop_front();
+            }
+            notFull.notify_all();
+            return true;
+        }
+
+        void close(){
+            lock_guard<mutex> lock(mtx);
+            closed = true;
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+
+    private:
+        size_t capacity;
+        bool closed{false};
+        deque<T> items;
+        mutex mtx;
+        condition_variable notEmpty;
+        condition_variable notFull;
+};
+
+#endif
\ No newline at end of file
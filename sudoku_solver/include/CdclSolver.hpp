@@ -0,0 +1,116 @@
+#ifndef CDCLSOLVER_HPP
+#define CDCLSOLVER_HPP
+
+#include <vector>
+
+#include "SudokuRules.hpp"
+#include "Deadline.hpp"
+
+using namespace std;
+
+/**
+ * Conflict-driven clause learning over the 729 boolean variables "cell c holds digit d".
+ * The rules are encoded as clauses: every cell holds at least one and at most one digit, two
+ * peers never hold the same digit and every digit appears in every unit of 9 cells. Sum units
+ * (killer cages) are not encoded up front, their clauses are generated lazily from the digits
+ * placed so far.
+ *
+ * Unlike the depth-first search, a dead end is analysed down to the decisions that caused it
+ * (first unique implication point); the resulting clause is learned, so the same dead end is
+ * never explored again, and the search jumps back to the level where that clause propagates.
+ * Restarts follow the Luby sequence and learned clauses are pruned at restarts.
+ */
+class CdclSolver{
+
+    public:
+        struct Stats{
+            // the counterpart of the DFS iterations
+            long decisions = 0;
+            long conflicts = 0;
+            long propagations = 0;
+            long learnedClauses = 0;
+            long restarts = 0;
+        };
+
+        // the search gives up once deadline expires, nullptr means no limit
+        explicit CdclSolver(const SudokuRules& rules, const Deadline* deadline = nullptr);
+
+        // values holds the digits of all cells (row-major), anything outside of 1..9 is empty; all of
+        // them are filled in if the puzzle has a solution
+        bool solve(int values[SudokuRules::nCells]);
+        const Stats& getStats() const {return stats;};
+        // solve() returned false because of the deadline, not because there is no solution
+        bool isStopped() const {return stopped;};
+
+    private:
+        struct Clause{
+            // lits[0] and lits[1] are watched
+            vector<int> lits;
+            bool learnt;
+        };
+
+        const SudokuRules& rules;
+        const Deadline* deadline;
+        bool stopped = false;
+        bool hasSums = false;
+        Stats stats;
+
+        vector<Clause> clauses;
+        // clauses watching each literal
+        vector<vector<int> > watches;
+        // per variable: 1 true, 0 false, -1 unassigned
+        vector<signed char> assigns;
+        vector<int> levels;
+        // clause that implied the variable, -1 for decisions and level 0, binaryReason() for
+        // the binary clauses that are not stored
+        vector<int> reasons;
+        vector<int> trail;
+        // start of every decision level in the trail
+        vector<int> trailLimits;
+        size_t propagated = 0;
+        vector<double> activity;
+        double activityIncrement = 1;
+        size_t maxLearnts = 2000;
+
+        // scratch
+        vector<int> conflict;
+        vector<int> learnt;
+        vector<int> toClear;
+        vector<int> sumLits;
+        vector<char> seen;
+
+        static int variable(int cell, int digit){return cell * SudokuRules::N + digit - 1;};
+        static int literal(int var, bool negated){return 2 * var + negated;};
+        static int binaryReason(int otherLit){return -2 - otherLit;};
+        static int binaryReasonLiteral(int reason){return -2 - reason;};
+        static int lubySequence(int i);
+
+        int value(int lit) const {
+            int v = assigns[lit >> 1];
+            return v < 0 ? -1 : v ^ (lit & 1);
+        };
+        int decisionLevel() const {return (int)trailLimits.size();};
+        // 0 if no digit is placed yet
+        int placedDigit(int cell) const;
+
+        void encode();
+        // adds and watches a clause of at least 2 literals
+        int addClause(const vector<int>& lits, bool isLearnt);
+        bool addUnit(int lit);
+        void assign(int lit, int reason);
+        // false if var is true already, the conflict is set then
+        bool assignFalse(int var, int placed);
+        // these return true on a conflict, which is left in conflict
+        bool propagate();
+        bool propagateClauses();
+        bool propagateSums();
+        // learns a clause from the conflict, which has to contain literals of the current level
+        void analyze(int& backjumpLevel);
+        void backtrack(int level);
+        void bumpActivity(int var);
+        int pickBranchVariable() const;
+        // drops satisfied clauses, false literals and the longer half of the learned clauses, only at level 0
+        void reduce();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef CELLCLEANER_HPP
+#define CELLCLEANER_HPP
+
+#include <vector>
+#include <opencv4/opencv2/core.hpp>
+
+using namespace std;
+
+// what is left in a cell after everything connected to its border is removed
+struct DigitBlob{
+    // number of foreground pixels
+    int area = 0;
+
+    bool empty() const {return area == 0;};
+};
+
+/**
+ * Removes the remains of the grid lines from a binary cell image: all 4-connected components
+ * that touch the border are cleared in a single pass. Components are found with union-find
+ * over the run-length encoded rows. Scratch buffers are kept between calls, so one instance
+ * should be reused for all cells (but not shared between threads).
+ */
+class CellCleaner{
+
+    public:
+        // clears the border components of the 8-bit binaryImg in place
+        DigitBlob clearBorder(cv::Mat& binaryImg);
+
+    private:
+        // foreground pixels [start, end) of one row
+        struct Run{
+            int row;
+            int start;
+            int end;
+        };
+        vector<Run> runs;
+        vector<int> parent;
+        vector<char> touchesBorder;
+
+        void encodeRuns(const cv::Mat& binaryImg);
+        void linkRuns();
+        int findRoot(int run);
+        void unite(int run1, int run2);
+};
+
+#endif
\ No newline at end of file
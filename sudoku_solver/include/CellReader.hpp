@@ -0,0 +1,68 @@
+#ifndef CELLREADER_HPP
+#define CELLREADER_HPP
+
+#include <array>
+#include <vector>
+#include <opencv4/opencv2/core.hpp>
+
+#include "Sudoku.hpp"
+#include "ImgProc.hpp"
+#include "MnistModel.hpp"
+#include "CellCleaner.hpp"
+
+using namespace std;
+
+struct CellResult{
+    int row = 0;
+    int col = 0;
+    DigitBlob digit;
+    // the cell was not cleaned because the deadline expired, it may hold a digit after all
+    bool skipped = false;
+    // most likely digits (without zero) with their probabilities, the most likely first
+    vector<pair<int, float> > candidates;
+
+    bool hasDigit() const {return !digit.empty();};
+    bool isDefinitive() const {return candidates[0].second >= MnistModel::acceptanceThreshold;};
+};
+
+/**
+ * Turns the binary grid of an ImgProc into recognized digits: the cells are cleaned in
+ * parallel, each thread with its own scratch buffers, and all non-empty cells are then
+ * classified by the neural-net in a single batch.
+ */
+class CellReader{
+
+    public:
+        static const int nCells = Sudoku::N * Sudoku::N;
+        typedef array<CellResult, nCells> CellResults;
+
+        /**
+         * clean + digitImages + recognition + assign. Once deadline expires the remaining cells
+         * are skipped and nothing is recognized, the cells found so far are kept.
+         */
+        static void read(const ImgProc& processor, MnistModel& model, CellResults& results,
+                         const Deadline* deadline = nullptr);
+
+        // read for every grid of a processor in multi-grid mode (ImgProc::runAll): the cells of all
+        // grids are cleaned in one parallel loop and their digits recognized in a single batch
+        static void readAll(const ImgProc& processor, MnistModel& model, vector<CellResults>& results,
+                            const Deadline* deadline = nullptr);
+
+        static void clean(const ImgProc& processor, CellResults& results, const Deadline* deadline = nullptr);
+        // with the cleaners (one per thread) kept by the caller, see FrameContext
+        static void clean(const ImgProc& processor, CellResults& results, vector<CellCleaner>& cleaners,
+                          const Deadline* deadline = nullptr);
+        // downsampled images of all non-empty cells, in row-major order
+        static vector<cv::Mat> digitImages(const ImgProc& processor, const CellResults& results);
+        // the digits are views into digitGrid, both are reused when they have the right size already
+        static void digitImages(const ImgProc& processor, const CellResults& results,
+                                cv::Mat& digitGrid, vector<cv::Mat>& digits);
+        // recognized holds the classes of the non-empty cells in the same order as digitImages
+        static void assign(CellResults& results, vector<pair<int, float> > const* recognized);
+        // all puzzles that are possible given the (uncertain) recognized digits; once deadline
+        // expires, the remaining uncertain cells only get their most likely digit
+        static vector<Sudoku> candidateGames(const CellResults& results, const Deadline* deadline = nullptr);
+        static void print(const CellResults& results);
+};
+
+#endif
\ No newline at end of file
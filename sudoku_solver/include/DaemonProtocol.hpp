@@ -0,0 +1,75 @@
+#ifndef DAEMONPROTOCOL_HPP
+#define DAEMONPROTOCOL_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Wire format between SudokuSolver --daemon and SudokuClient over a Unix domain socket.
+ * Every request is a RequestHeader followed by `length` bytes of payload. Requests can be
+ * pipelined; responses (a ResponseHeader, the grid and the confidences) come back in the
+ * order the requests were sent. Integers are in host byte order since both ends are local.
+ */
+class DaemonProtocol{
+
+    public:
+        static const uint32_t requestMagic = 0x514b4453;   // "SDKQ"
+        static const uint32_t responseMagic = 0x524b4453;  // "SDKR"
+        static const int nCells = 81;
+
+        enum RequestType : uint32_t {
+            // payload is an encoded (png, jpg, ...) image
+            IMAGE = 1,
+            // payload is 81 characters, '1'-'9' for given digits, '0' or '.' for empty cells
+            PUZZLE = 2
+        };
+
+        enum Status : uint32_t {
+            SOLVED = 0,
+            NO_GRID = 1,
+            UNSOLVABLE = 2,
+            BAD_REQUEST = 3,
+            // the latency budget of the daemon ran out, the grid holds what was recognized so far
+            TIMED_OUT = 4,
+            // the daemon failed on this request (e.g. an error of the model), it keeps serving
+            FAILED = 5
+        };
+
+        struct RequestHeader{
+            uint32_t magic;
+            uint32_t type;
+            uint32_t id;
+            uint32_t length;
+        };
+
+        struct ResponseHeader{
+            uint32_t magic;
+            uint32_t id;
+            uint32_t status;
+            // time the daemon spent on the request
+            uint32_t serviceMicros;
+        };
+
+        struct Response{
+            ResponseHeader header;
+            // '1'-'9', '.' where nothing is known
+            char grid[nCells];
+            // probability of the recognized digit, 1 for given digits, 0 for the ones filled by the solver
+            float confidences[nCells];
+        };
+
+        // both return false when the socket was closed or failed, interrupted calls are retried
+        static bool readFully(int fd, void* buffer, size_t size);
+        static bool writeFully(int fd, const void* buffer, size_t size);
+
+        static bool sendRequest(int fd, uint32_t type, uint32_t id, const vector<char>& payload);
+        static bool receiveResponse(int fd, Response& response);
+
+        static int connectTo(const string& socketPath);
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef DEADLINE_HPP
+#define DEADLINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * Latency budget and cancellation token of one request. The stages check expired()
+ * cooperatively in their loops and stop early, keeping whatever they have so far; the token is
+ * passed as a pointer, nullptr meaning unbounded. cancel() may be called from any thread.
+ *
+ * Once expired() returned true it stays true and stopReason() tells why, so that every stage
+ * reports the same reason.
+ */
+class Deadline{
+
+    public:
+        enum StopReason {NONE, TIMEOUT, CANCELLED};
+
+        // loops call expired() only every checkInterval iterations, reading the clock costs ~20 ns
+        static const int checkInterval = 256;
+
+        // only expires when cancelled
+        Deadline();
+        // budgetMs <= 0 means no time limit
+        explicit Deadline(double budgetMs);
+        Deadline(const Deadline&) = delete;
+        Deadline& operator=(const Deadline&) = delete;
+
+        void cancel() {cancelled.store(true, memory_order_relaxed);};
+        bool expired() const;
+        StopReason stopReason() const {return (StopReason)reason.load(memory_order_relaxed);};
+        bool isBounded() const {return bounded;};
+        double getBudgetMs() const {return budgetMs;};
+        double elapsedMs() const;
+        // how long ago the deadline passed, 0 before it or without a time limit
+        double overrunMs() const;
+
+        static const char* toString(StopReason reason);
+
+    private:
+        chrono::steady_clock::time_point start;
+        chrono::steady_clock::time_point end;
+        double budgetMs = 0;
+        bool bounded = false;
+        atomic<bool> cancelled{false};
+        mutable atomic<int> reason{NONE};
+};
+
+// thrown by stages that have no partial result to return, e.g. the grid detection
+class DeadlineExceeded: public exception{
+
+    public:
+        explicit DeadlineExceeded(Deadline::StopReason reason): reason(reason) {};
+        const char* what() const noexcept override {return Deadline::toString(reason);};
+
+        const Deadline::StopReason reason;
+};
+
+/**
+ * Process-wide counters of the deadlines of finished requests, to see how often the budget is
+ * missed and by how much. A request overran if it returned after its deadline, whether a stage
+ * noticed and stopped early or not.
+ */
+class DeadlineMetrics{
+
+    public:
+        struct Snapshot{
+            long requests = 0;
+            // requests with a time limit
+            long bounded = 0;
+            long timedOut = 0;
+            long cancelled = 0;
+            long overruns = 0;
+            double totalOverrunMs = 0;
+            double maxOverrunMs = 0;
+
+            double overrunRate() const {return bounded ? (double)overruns / bounded : 0;};
+            double meanOverrunMs() const {return overruns ? totalOverrunMs / overruns : 0;};
+        };
+
+        // call once the request is answered
+        static void record(const Deadline& deadline);
+        static Snapshot snapshot();
+        static void reset();
+        static void print(ostream& out);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef DEBUGSINK_HPP
+#define DEBUGSINK_HPP
+
+#include <string>
+#include <thread>
+#include <utility>
+#include <opencv4/opencv2/core.hpp>
+
+#include "BlockingQueue.hpp"
+
+using namespace std;
+
+/**
+ * Collects debug visualizations and writes them to a directory on a background thread,
+ * so that producing them never blocks the processing: when the writer falls `capacity` images
+ * behind, further images are dropped (and counted) until it catches up. Images are numbered in
+ * the order they are submitted, dropped ones leave a gap.
+ */
+class DebugSink{
+
+    public:
+        explicit DebugSink(const string& directory, size_t capacity = 64);
+        // writes everything that is still queued, reports how many images were dropped
+        ~DebugSink();
+
+        DebugSink(DebugSink const&) = delete;
+        void operator=(DebugSink const&) = delete;
+
+        // img is copied, the caller can reuse it right away
+        void submit(const string& name, const cv::Mat& img);
+
+    private:
+        string directory;
+        int counter{0};
+        int dropped{0};
+        mutex counterMutex;
+        BlockingQueue<pair<string, cv::Mat> > queue;
+        thread writer;
+
+        void writeImages();
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef DIGITNET_HPP
+#define DIGITNET_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <torch/torch.h>
+
+/**
+ * Architecture of the digit classifier: a stack of convolutions, each followed by a LeakyReLU
+ * and a 2x2 max-pooling, then one hidden fully connected layer. The defaults are the net the
+ * project has always used (64 and 128 channels feeding a 3200x256 linear layer), so models
+ * saved before stay loadable.
+ *
+ * With separable, every convolution but the first is split into a depthwise kxk and a
+ * pointwise 1x1 convolution, which needs about k*k times fewer multiply-adds. pruneRatio is
+ * the fraction of the channels of every layer that structured pruning removes, the net that
+ * is built and deployed has the remaining ones; see MnistModel::trainModel.
+ */
+struct DigitNetConfig{
+    std::string name = "baseline";
+    // side of the square input, the 28x28 cell images are resized to it
+    int inputSize = 28;
+    // output channels and kernel sizes of the convolutions
+    std::vector<int> channels = {64, 128};
+    std::vector<int> kernels = {5, 3};
+    bool separable = false;
+    int hidden = 256;
+    float dropout = 0.5f;
+    float pruneRatio = 0.0f;
+
+    // channels of every layer once pruneRatio is applied, at least one
+    std::vector<int> keptChannels() const;
+    // same architecture without pruning, what pruning starts from
+    DigitNetConfig unpruned() const;
+    // ./model.pt for the baseline, ./model_<name>.pt for the others
+    std::string defaultModelPath() const;
+};
+
+// analytic cost of one forward pass of one image
+struct DigitNetCost{
+    int64_t params = 0;
+    // multiply-adds of the convolutions and linear layers, activations and pooling not counted
+    int64_t macs = 0;
+    int64_t flops() const {return 2 * macs;};
+};
+
+class DigitNet{
+
+    public:
+        static const int nClasses = 10;
+
+        // throws if the input is too small for the convolutions
+        static torch::nn::Sequential build(const DigitNetConfig& config);
+        static DigitNetCost cost(const DigitNetConfig& config);
+        /**
+         * Structured pruning: every layer keeps the output channels whose filters have the
+         * largest L1 norm, and the next layer the matching input channels. net has to be built
+         * from config.unpruned(), the result has the architecture of config and needs fine-tuning.
+         */
+        static torch::nn::Sequential prune(torch::nn::Sequential& net, const DigitNetConfig& config);
+
+        // the variants compared by DigitNetReport, baseline first
+        static std::vector<DigitNetConfig> presets();
+        // throws for unknown names
+        static DigitNetConfig preset(const std::string& name);
+
+    private:
+        // module indices of the layers within the Sequential built from config
+        struct Layout{
+            // -1 for full convolutions
+            std::vector<int> depthwise;
+            // the full or pointwise convolution of every layer
+            std::vector<int> conv;
+            int hidden = 0;
+            int output = 0;
+            // side of the feature maps after the last pooling
+            int finalSide = 0;
+        };
+
+        static Layout layout(const DigitNetConfig& config);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef FRAMECONTEXT_HPP
+#define FRAMECONTEXT_HPP
+
+#include <vector>
+#include <opencv4/opencv2/core.hpp>
+
+#include "ImgProc.hpp"
+#include "CellCleaner.hpp"
+#include "CellReader.hpp"
+
+using namespace std;
+
+// allocations counted by AllocationCounter during one frame
+struct FrameAllocations{
+    size_t heap = 0;
+    size_t mats = 0;
+};
+
+/**
+ * Reusable state for processing a stream of frames, e.g. from a camera: grid detection, cell
+ * cleaning and downsampling of the digits, up to the input of the neural-net. Every buffer is
+ * sized on the first frame and kept for later frames of the same size; what the OpenCV calls
+ * allocate internally is shown by getLastAllocations(). Not thread-safe, use one context per thread.
+ */
+class FrameContext{
+
+    public:
+        explicit FrameContext(const ImgProcParams& params = ImgProcParams());
+
+        // false if no grid was found (or deadline expired before), the digits are ready for
+        // MnistModel::inferClasses otherwise
+        bool process(const cv::Mat& img, const Deadline* deadline = nullptr);
+
+        const ImgProc& getProcessor() const {return processor;};
+        CellReader::CellResults& getCells() {return cells;};
+        // views of the non-empty cells in row-major order, valid until the next frame
+        const vector<cv::Mat>& getDigits() const {return digits;};
+        // what the last process() allocated, heap is only counted with SUDOKU_COUNT_ALLOCATIONS and
+        // for the whole process, so it is only meaningful while no other thread is busy
+        const FrameAllocations& getLastAllocations() const {return lastAllocations;};
+
+    private:
+        ImgProc processor;
+        CellReader::CellResults cells;
+        vector<CellCleaner> cleaners;
+        cv::Mat digitGrid;
+        vector<cv::Mat> digits;
+        FrameAllocations lastAllocations;
+};
+
+#endif
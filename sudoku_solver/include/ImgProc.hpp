@@ -6,17 +6,62 @@
 #include <opencv4/opencv2/core.hpp>
 #include <opencv4/opencv2/core/utility.hpp>
 #include <opencv4/opencv2/imgproc.hpp>
-#include <opencv4/opencv2/highgui.hpp>
+
+#include "AxisHough.hpp"
+#include "DebugSink.hpp"
+#include "Deadline.hpp"
 
 using namespace std;
 
+struct ImgProcParams{
+    // lines further than this (in degrees) from horizontal or vertical are ignored
+    double houghAngleWindow = 5;
+    // side (in px) of one cell in the perspective-rectified grid
+    int cellSize = 32;
+    // images with a larger side are detected on a downscaled pyramid level, 0 disables it
+    int detectionMaxSide = 1024;
+    // most grids runAll() returns
+    int maxGrids = 16;
+    // smallest grid side runAll() looks for, relative to the smaller image side; the Hough threshold
+    // is scaled to it, since the lines of a grid only get as many votes as the grid is long
+    float minGridFraction = 0.25;
+    // receives visualizations of the intermediate steps, nullptr disables them
+    DebugSink* debugSink = nullptr;
+};
+
+/**
+ * Finds the sudoku grid in a grayscale image and cuts it into binarized cells. All intermediate
+ * images and vectors are members, so an instance that is reused with run(img) for frames of the
+ * same size does not allocate anything after the first frame (apart from the debug output).
+ * The input image is referenced, not copied, and must not change while run() is busy.
+ *
+ * runAll() finds every grid of a page instead: the Hough lines, their intersections and the
+ * contours are computed once, then each grid is clustered, rectified and binarized on its own.
+ * The getters take the index of the grid, the first one is all there is after run().
+ */
 class ImgProc{
 
     public:
-        explicit ImgProc(const cv::Mat& img);
-        void run();
+        explicit ImgProc(const ImgProcParams& params = ImgProcParams());
+        ImgProc(const cv::Mat& img, const ImgProcParams& params);
+        // both throw if no grid is found, DeadlineExceeded if deadline expires before
+        void run(const Deadline* deadline = nullptr);
+        void run(const cv::Mat& img, const Deadline* deadline = nullptr);
+        // multi-grid mode, returns the number of grids found (0 is not an error), top to bottom and
+        // left to right; throws DeadlineExceeded only
+        int runAll(const Deadline* deadline = nullptr);
+        int runAll(const cv::Mat& img, const Deadline* deadline = nullptr);
+        int getNumGrids() const {return nGrids;};
         // cv::Mat getProcessedImg();
-        vector<vector<cv::Rect> > getSudokuCells() const;
+        const vector<vector<cv::Rect> >& getSudokuCells(int grid = 0) const {return grids[grid].cells;};
+        // rectified, inverted and binarized grid of 9x9 cells, each cellSize x cellSize
+        cv::Mat getBinaryGrid(int grid = 0) const {return grids[grid].binary;};
+        // zero-copy view of a single cell of the binary grid
+        cv::Mat getBinaryCell(int row, int col, int grid = 0) const;
+        int getCellSize() const {return params.cellSize;};
+        cv::Rect getSudokuROI(int grid = 0) const {return grids[grid].roi;};
+        // grid intersections at full resolution
+        const vector<cv::Point2f>& getGridIntersections(int grid = 0) const {return grids[grid].intersections;};
 
         static cv::Mat invertImg(const cv::Mat& input);
         static bool isSquare(const cv::Rect& r);
@@ -28,24 +73,73 @@ class ImgProc{
         static bool isHorizontal(const cv::Vec2f& line, double degThreshold=5);
         static bool isVertical(const cv::Vec2f& line, double degThreshold=5);
         static bool isHorizontalOrVertical(const cv::Vec2f& line, double degThreshold=5);
+        static cv::Rect cellRect(int row, int col, int cellSize);
 
     private:
+        // everything that is found per grid, at full resolution
+        struct Grid{
+            cv::Rect roi;
+            vector<cv::Point2f> intersections;
+            vector<vector<cv::Rect> > cells = vector<vector<cv::Rect> >(9, vector<cv::Rect>(9));
+            cv::Mat rectified;
+            cv::Mat binary;
+        };
+
+        ImgProcParams params;
+        // of the current run(), nullptr when it is unbounded
+        const Deadline* deadline = nullptr;
+        AxisHough hough;
         cv::Mat origImg;
+        // levels of the pyramid of origImg, only filled for large images
+        vector<cv::Mat> pyramid;
+        // origImg or a level of its pyramid on which the grid is detected
+        cv::Mat detectionImg;
+        float detectionScale{1};
+        cv::Mat invertedImg;
+        cv::Mat houghMask;
         cv::Mat processedImg;
         vector<cv::Vec2f> houghLines;
+        vector<cv::Vec2f> horizontalLines;
+        vector<cv::Vec2f> verticalLines;
         vector<cv::Point2f> houghIntersections;
+        vector<vector<cv::Point> > contours;
+        vector<cv::Vec4i> hierarchy;
+        vector<cv::Rect> contourRects;
+        vector<pair<int, cv::Rect> > roiCandidates;
+        // grid ROIs in the detection image
+        vector<cv::Rect> detectionROIs;
+        vector<cv::Point2f> sudokuIntersections;
+        cv::Mat kmeansLabels;
+        vector<cv::Point2f> clusterCenters;
+        // rectified grid to image, of the last rectifyGrid()
+        cv::Mat perspective;
         vector<cv::Point2i> kmeansIntersections;
-        cv::Rect sudokuROI;
-        vector<vector<cv::Rect> > sudokuCells;
+        vector<cv::Point2i> intersectionsInCell;
+        // grows but never shrinks, so that the buffers of the grids are kept between frames
+        vector<Grid> grids = vector<Grid>(1);
+        int nGrids = 0;
+        cv::Mat invertedGrid;
 
-        void processImg();
-        cv::Mat houghExtraction(cv::Mat& img);
+        // throws DeadlineExceeded once the deadline expired
+        void checkDeadline() const;
+        void buildDetectionImg();
+        // gridFraction: expected grid side relative to the smaller image side
+        void processImg(float gridFraction);
+        void houghExtraction(const cv::Mat& img, float gridFraction);
         void calcHoughIntersections();
 
-        void locateSudokuCells();
+        void toFullResolution(const cv::Rect& detectionROI, const vector<cv::Point2f>& centers, Grid& grid);
+        void locateSudokuCells(Grid& grid);
+        void rectifyGrid(Grid& grid);
+        void binarizeCells(Grid& grid);
 
-        cv::Rect locateSudokuROI(const vector<vector<cv::Point> >& contours);
+        cv::Rect locateSudokuROI(const vector<cv::Rect>& rects);
+        // every square with the intersections of a whole grid that overlaps none of the others
+        void locateSudokuROIs(const vector<cv::Rect>& rects, vector<cv::Rect>& rois);
+        void findContours();
         void findSudokuGrid();
+        // clusters the intersections within detectionROI into the grid and rectifies it
+        void extractGrid(const cv::Rect& detectionROI, Grid& grid, const string& debugName);
 
 };
 
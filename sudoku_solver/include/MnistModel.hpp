@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <functional>
+#include <mutex>
 #include <queue>
 #include <vector>
 
@@ -11,6 +12,21 @@
 #include <opencv4/opencv2/highgui.hpp>
 #include <opencv4/opencv2/imgproc.hpp>
 
+#include "DigitNet.hpp"
+
+class MnistModel;
+
+struct TrainOptions{
+    int epochs = 10;
+    // knowledge distillation: the loss mixes in, with distillWeight, the divergence from the
+    // predictions of teacher softened by temperature
+    MnistModel* teacher = nullptr;
+    float distillWeight = 0.7f;
+    float temperature = 4.0f;
+    // training epochs once the net is pruned, only with a pruneRatio in the config
+    int fineTuneEpochs = 3;
+};
+
 class MnistModel{
 
     public:
@@ -19,43 +35,61 @@ class MnistModel{
             return instance;
         }
 
+        // modelPath defaults to config.defaultModelPath(), the model is loaded on the first inference
+        explicit MnistModel(const DigitNetConfig& config, const std::string& modelPath = "");
         MnistModel(MnistModel const&) = delete;
         void operator=(MnistModel const&) = delete;
 
         void testLibTorch();
-        void trainModel();
+        // trains (and prunes) the net on MNIST and saves it at the model path
+        void trainModel(const TrainOptions& options = TrainOptions());
+        // share of the MNIST test set classified correctly
+        double testAccuracy();
+        // log-probabilities of a batch of normalized 28x28 images, resized to the input of the net
+        torch::Tensor logProbabilities(const torch::Tensor& images);
         std::vector<std::pair<int, float> > inferClass(const cv::Mat& digit);
+        // classifies all digits with a single forward pass
+        std::vector<std::vector<std::pair<int, float> > > inferClasses(const std::vector<cv::Mat>& digits);
 
         static cv::Mat convertImg(torch::Tensor input);
         static torch::Tensor convertImg(const cv::Mat& input);
 
+        const DigitNetConfig& getConfig() const {return config;};
+        const std::string& getModelPath() const {return modelPath;};
+
         constexpr static const float acceptanceThreshold = 0.8f;
+        // side of the (square) digit images handed to the model, they are resized to the input
+        // of the net when it differs
+        constexpr static const int inputSize = 28;
 
     private:
         MnistModel();
 
         const int trainBatchSize = 64;
         const int testBatchSize = 512;
-        const int numberOfEpochs = 10;
         const int logInterval= 10;
-        const int nClasses = 10;
+        const int nClasses = DigitNet::nClasses;
 
         const float dataMean = 0.1307f;
         const float dataStd = 0.3081f;
 
         const std::string dataPath = "./mnist";
-        const std::string modelPath = "./model.pt";
+        const DigitNetConfig config;
+        const std::string modelPath;
         torch::Device device = torch::Device(c10::DeviceType::CPU);
         torch::nn::Sequential net;
         bool readyForInference;
+        std::mutex inferenceMutex;
 
-        torch::nn::Sequential getModel();
+        void prepareInference();
+        std::vector<std::pair<int, float> > topClasses(const float* probs) const;
 
         template <typename DataLoader>
         void trainEpoch(int32_t epoch, torch::nn::Sequential& model, DataLoader& data_loader,
-                        torch::optim::Optimizer& optimizer, size_t dataset_size);
+                        torch::optim::Optimizer& optimizer, size_t dataset_size, const TrainOptions& options);
+        // returns the accuracy
         template <typename DataLoader>
-        void test(torch::nn::Sequential& model, DataLoader& data_loader, size_t dataset_size);
+        double test(torch::nn::Sequential& model, DataLoader& data_loader, size_t dataset_size);
 
 };
 
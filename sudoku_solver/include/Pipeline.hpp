@@ -0,0 +1,85 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <string>
+#include <vector>
+#include <opencv4/opencv2/core.hpp>
+
+#include "Sudoku.hpp"
+#include "ImgProc.hpp"
+#include "MnistModel.hpp"
+#include "CellReader.hpp"
+
+using namespace std;
+
+struct SolveOptions{
+    // set imgProcParams.debugSink to get the visualizations of the image processing
+    ImgProcParams imgProcParams;
+    // nullptr means MnistModel::getInstance()
+    MnistModel* model = nullptr;
+    // threads that solve the candidate puzzles
+    int solverThreads = 2;
+    Sudoku::Backend solverBackend = Sudoku::DFS;
+    // latency budget of one image, 0 for none; ignored when a deadline is given
+    double budgetMs = 0;
+    // lets the caller cancel the call from another thread, nullptr means budgetMs
+    Deadline* deadline = nullptr;
+};
+
+struct SolveResult{
+    bool gridFound = false;
+    string error;
+    // position of each cell in the input image
+    vector<vector<cv::Rect> > cellRects;
+    CellReader::CellResults cells;
+    // number of puzzles that were possible given the recognized digits
+    size_t nCandidates = 0;
+    // solved candidates, the one with the most probable digits first
+    vector<Sudoku> solutions;
+    // why the call stopped early and in which stage; the results of the earlier stages are kept,
+    // e.g. the recognized digits without a solution
+    Deadline::StopReason stopReason = Deadline::NONE;
+    string stoppedStage;
+
+    bool isSolved() const {return !solutions.empty();};
+    bool isStopped() const {return stopReason != Deadline::NONE;};
+};
+
+// every grid of one page, in reading order
+struct PageResult{
+    // one result per grid found, with its own cell positions, digits and solutions
+    vector<SolveResult> grids;
+    // set when no grid was found at all
+    string error;
+    Deadline::StopReason stopReason = Deadline::NONE;
+    string stoppedStage;
+
+    bool isStopped() const {return stopReason != Deadline::NONE;};
+};
+
+/**
+ * Whole pipeline for a single grayscale image: grid detection, digit recognition and
+ * solving. Nothing is shown or waited for, so it can be called from a server or a benchmark.
+ * Every call is recorded in DeadlineMetrics.
+ */
+SolveResult solveImage(const cv::Mat& img, const SolveOptions& options = SolveOptions());
+
+/**
+ * Multi-grid version of solveImage for pages with several puzzles (ImgProcParams::maxGrids).
+ * The detection runs once for the page, the digits of all grids are recognized in a single
+ * batch and the grids are solved concurrently.
+ * options.deadline or budgetMs bounds the whole page; the call is recorded once in DeadlineMetrics.
+ */
+PageResult solveImageGrids(const cv::Mat& img, const SolveOptions& options = SolveOptions());
+
+// solves all valid games, returns the solved ones sorted by the probability of their digits;
+// games that are not started or not finished before deadline expires are left unsolved
+vector<Sudoku> solveCandidates(vector<Sudoku>& games, int nThreads, Sudoku::Backend backend = Sudoku::DFS,
+                               const Deadline* deadline = nullptr);
+
+// writes the digits of game into the cells of img
+void drawResult(const cv::Mat& img, cv::Mat& drawing, const vector<vector<cv::Rect> >& cells, const Sudoku& digits);
+// writes the best solution of every solved grid of page into img
+void drawResults(const cv::Mat& img, cv::Mat& drawing, const PageResult& page);
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef PUZZLEFILE_HPP
+#define PUZZLEFILE_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Sudoku.hpp"
+
+using namespace std;
+
+/**
+ * Packed puzzle corpus: a Header followed by `count` records of `recordSize` bytes, so record i
+ * starts at sizeof(Header) + i * recordSize. A record holds
+ *
+ *   41 bytes   the givens, 4 bits per cell in row-major order (low nibble first), 0 for empty
+ *   41 bytes   the solution, same packing, only with HAS_SOLUTION (all 0 when unknown)
+ *    4 bytes   the difficulty, only with HAS_DIFFICULTY
+ *
+ * Integers are in the byte order of the machine that wrote the file (little-endian on x86 and
+ * ARM), the format is not meant to move between byte orders: a reader on the other one sees a
+ * byte-swapped magic and rejects the file. A puzzle takes 41 instead of 82 bytes of text, and
+ * decoding is a shift and a mask per cell instead of parsing.
+ */
+class PuzzleFile{
+
+    public:
+        static const uint32_t magic = 0x504b4453;  // "SDKP"
+        static const uint16_t version = 1;
+        static const int nCells = Sudoku::N * Sudoku::N;
+        static const int packedSize = (nCells + 1) / 2;
+
+        enum Flags : uint16_t {
+            HAS_SOLUTION = 1,
+            HAS_DIFFICULTY = 2
+        };
+
+        struct Header{
+            uint32_t magic;
+            uint16_t version;
+            uint16_t flags;
+            uint32_t recordSize;
+            uint32_t reserved;
+            uint64_t count;
+        };
+
+        static uint32_t recordSize(uint16_t flags);
+        // values: digits of all cells (row-major), 0 or UNASSIGNED for empty; false if a value is
+        // larger than 9, that cell is stored empty so that no corrupt record is written
+        static bool pack(const int values[nCells], uint8_t packed[packedSize]);
+        // empty cells become 0; false if a nibble is not a digit (corrupt file), those cells become 0 too
+        static bool unpack(const uint8_t packed[packedSize], int values[nCells]);
+        // 81 characters, '1'-'9' for digits, anything else is empty; false if line is shorter
+        static bool parseText(const string& line, int values[nCells], size_t offset = 0);
+        static string toText(const int values[nCells]);
+};
+
+/**
+ * Read-only view of a puzzle file mapped into memory. Records are decoded straight from the
+ * mapping, nothing is copied or allocated per record. The header is validated when the file is
+ * opened, the records when they are decoded: a corrupt record has cells that are not digits, which
+ * are decoded as empty and make the getters return false. So does an index past the last record,
+ * which leaves values (or game) untouched.
+ */
+class PuzzleFileReader{
+
+    public:
+        explicit PuzzleFileReader(const string& path);
+        ~PuzzleFileReader();
+        PuzzleFileReader(const PuzzleFileReader&) = delete;
+        PuzzleFileReader& operator=(const PuzzleFileReader&) = delete;
+
+        size_t size() const {return count;};
+        uint32_t getRecordSize() const {return stride;};
+        bool hasSolutions() const {return flags & PuzzleFile::HAS_SOLUTION;};
+        bool hasDifficulty() const {return flags & PuzzleFile::HAS_DIFFICULTY;};
+
+        bool getGivens(size_t index, int values[PuzzleFile::nCells]) const {
+            return index < count && PuzzleFile::unpack(record(index), values);
+        };
+        // false if the file has no solutions or the solution of this puzzle is unknown or corrupt
+        bool getSolution(size_t index, int values[PuzzleFile::nCells]) const;
+        // 0 without difficulties or past the last record
+        uint32_t getDifficulty(size_t index) const;
+        // overwrites game with the givens of the puzzle, reusing its buffers
+        bool read(size_t index, Sudoku& game) const;
+
+    private:
+        const uint8_t* data = nullptr;
+        size_t mappedSize = 0;
+        size_t count = 0;
+        uint32_t stride = 0;
+        uint16_t flags = 0;
+
+        const uint8_t* record(size_t index) const {return data + sizeof(PuzzleFile::Header) + index * stride;};
+};
+
+/**
+ * Appends records to a new puzzle file through a fixed-size buffer; the header gets its final
+ * count on close(). write() and close() throw if the file cannot be written (e.g. the disk is
+ * full), call close() to learn about it, the destructor cannot report it.
+ */
+class PuzzleFileWriter{
+
+    public:
+        PuzzleFileWriter(const string& path, uint16_t flags);
+        ~PuzzleFileWriter();
+        PuzzleFileWriter(const PuzzleFileWriter&) = delete;
+        PuzzleFileWriter& operator=(const PuzzleFileWriter&) = delete;
+
+        // solution is ignored without HAS_SOLUTION, nullptr stores an unknown one; false if a value is
+        // not a digit, see PuzzleFile::pack
+        bool write(const int givens[PuzzleFile::nCells], const int* solution = nullptr, uint32_t difficulty = 0);
+        // the filled cells of puzzle are the givens
+        bool write(const Sudoku& puzzle, const Sudoku* solution = nullptr, uint32_t difficulty = 0);
+        void close();
+        size_t size() const {return count;};
+
+    private:
+        static const size_t bufferSize = 1 << 16;
+
+        string path;
+        ofstream file;
+        uint16_t flags;
+        uint32_t stride;
+        size_t count = 0;
+        vector<uint8_t> buffer;
+
+        void flush();
+        // throws if a write failed
+        void check();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef SOLVERDAEMON_HPP
+#define SOLVERDAEMON_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Pipeline.hpp"
+#include "DaemonProtocol.hpp"
+
+using namespace std;
+
+/**
+ * Long running process that keeps the neural-net loaded and answers requests (images or
+ * puzzles) over a Unix domain socket, see DaemonProtocol. Each connection is served by its
+ * own threads: one reads the (possibly pipelined) requests while the other solves and answers.
+ * The deadline metrics (DeadlineMetrics) are printed every reportInterval seconds while requests
+ * come in, and once more when the daemon stops.
+ */
+class SolverDaemon{
+
+    public:
+        static const int reportInterval = 60;
+
+        SolverDaemon(const string& socketPath, const SolveOptions& options);
+        ~SolverDaemon();
+
+        // loads the model and runs it once, so that the first request does not pay for it
+        void warmUp();
+        // accepts connections until stop() is called, then closes all connections, waits for
+        // their threads and prints how many requests were served
+        void serve();
+        // makes serve() stop accepting and return; only sets a flag and shuts the listening socket
+        // down, so it can be called from another thread or a signal handler
+        void stop();
+
+    private:
+        struct Request{
+            DaemonProtocol::RequestHeader header;
+            vector<char> payload;
+        };
+
+        string socketPath;
+        SolveOptions options;
+        int listenFd{-1};
+        atomic<bool> running{false};
+        atomic<long> nRequests{0};
+        // steady clock time of the last printed metrics
+        atomic<long long> lastReport{0};
+
+        set<int> connections;
+        mutex connectionsMutex;
+        condition_variable connectionsDone;
+
+        void closeConnections();
+        void serveConnection(int fd);
+        DaemonProtocol::Response handle(const Request& request);
+        // prints the metrics if the last report is older than reportInterval
+        void reportPeriodically();
+        void solveImageRequest(const Request& request, DaemonProtocol::Response& response);
+        void solvePuzzleRequest(const Request& request, DaemonProtocol::Response& response);
+};
+
+#endif
@@ -7,16 +7,37 @@
 #include "tuple"
 #include <math.h>
 #include <iostream>
+#include <memory>
+
+#include "SudokuRules.hpp"
+#include "Deadline.hpp"
 
 using namespace std;
 
 class Sudoku{
 
     public:
+        // DFS: depth-first search, CDCL: conflict-driven clause learning (see CdclSolver.hpp),
+        // which bounds the time of puzzles that are pathological for the search
+        enum Backend {DFS, CDCL};
+        // how resolve() found the solution: the previous one still holds, a search of the cells
+        // around the changes, or a search of the whole puzzle
+        enum Resolve {REUSED, LOCAL, FULL};
+
+        // a given (recognized digit) that changed, a value outside of 1..9 removes it
+        struct CellChange{
+            int row;
+            int col;
+            int value;
+            double probability = UNASSIGNED;
+        };
+
         // default constructor
         Sudoku() = default;
         // conversion constructor
         explicit Sudoku(vector<vector <int> >& grid): grid(grid) {};
+        // variant puzzles (X, jigsaw, killer, ...)
+        Sudoku(vector<vector <int> >& grid, shared_ptr<const SudokuRules> rules): grid(grid), rules(rules) {};
         // explicit copy-constructor
         explicit Sudoku(const Sudoku& other);
         // move constructor
@@ -28,7 +49,26 @@ class Sudoku{
         double getJoinProbability() const ;
         bool isValid() const;
         bool isSolved() const {return this->solved;};
+        // DFS: visited search nodes, CDCL: decisions
+        int getIterations() const {return this->nIters;};
+        // DFS: dead ends, CDCL: conflicts
+        int getConflicts() const {return this->nConflicts;};
+        void setBackend(Backend backend){this->backend = backend;};
+        Backend getBackend() const {return this->backend;};
+        // solve() gives up (returns false) once deadline expires, nullptr means no limit
+        void setDeadline(const Deadline* deadline){this->deadline = deadline;};
+        // the last solve() gave up because of the deadline, the puzzle may still be solvable
+        bool isStopped() const {return this->stopped;};
         bool solve();
+        /**
+         * Solves the puzzle again after a few of its givens changed, e.g. between video frames or
+         * when the user corrects a digit. A solved puzzle keeps its solution if it agrees with
+         * the changes, otherwise only the cells that share a unit with a changed one are searched
+         * again and the whole puzzle only if that fails. Without a previous solution it is solve().
+         * Returns false if the changed givens contradict the others (no exception, unlike solve()).
+         */
+        bool resolve(const vector<CellChange>& changes);
+        Resolve getLastResolve() const {return this->lastResolve;};
 
         void print() const;
 
@@ -36,13 +76,31 @@ class Sudoku{
         float getProb(int row, int col) const {return probabilities[row][col];};
 
         bool trySolve(vector<vector<int> >& grid);
+        // replaces the whole grid (row-major, 0 or UNASSIGNED for empty cells) without reallocating,
+        // the probabilities and the solved state are cleared
+        void reset(const int* values);
+        const SudokuRules& getRules() const {return *rules;};
         static const int N = 9;
 
     private:
         bool solved{false};
+        bool stopped{false};
         int nIters{0};
+        int nConflicts{0};
+        Backend backend{DFS};
+        Resolve lastResolve{FULL};
+        const Deadline* deadline{nullptr};
         vector<vector<int> > grid = vector<vector <int> >(N, vector<int>(N, UNASSIGNED));
         vector<vector<double> > probabilities = vector<vector <double> >(N, vector<double>(N, UNASSIGNED));
+        shared_ptr<const SudokuRules> rules = SudokuRules::classic();
+        // the givens of the last solve(), row-major with 0 for empty cells; grid holds the solution
+        vector<int> givens = vector<int>(SudokuRules::nCells, 0);
+
+        // grid back to the givens, unsolved
+        void restoreGivens();
+        // searches the cells whose digit in grid (the previous solution) is in the digits mask again,
+        // the others keep theirs; on success grid is the new solution
+        bool localSearch(int digits, vector<vector<int> >& local);
 
 };
 
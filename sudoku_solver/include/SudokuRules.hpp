@@ -0,0 +1,75 @@
+#ifndef SUDOKURULES_HPP
+#define SUDOKURULES_HPP
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+/**
+ * The constraints of a sudoku as a table of units: every unit is a set of cells whose digits
+ * have to be distinct and, optionally, add up to a given sum (killer cages). Classic sudoku
+ * has the 9 rows, 9 columns and 9 boxes, variants add diagonals (X-sudoku), replace the boxes by
+ * irregular regions (jigsaw) or add cages (killer).
+ *
+ * Whenever the units change, the units of every cell and the peers of every cell are compiled
+ * into flat tables, so the solver only combines the digit masks of a few units per cell.
+ * Digit masks have bit d-1 set for digit d. Cells are numbered row-major, 0..80.
+ */
+class SudokuRules{
+
+    public:
+        static const int N = 9;
+        static const int nCells = N * N;
+        static const int allDigits = (1 << N) - 1;
+
+        struct Unit{
+            vector<int> cells;
+            // required sum of the digits, 0 for none
+            int sum = 0;
+        };
+
+        // classic rules: rows, columns and 3x3 boxes
+        SudokuRules();
+        // shared instance of the classic rules
+        static shared_ptr<const SudokuRules> classic();
+
+        // X-sudoku, the digits on both main diagonals are distinct too
+        void addDiagonals();
+        // jigsaw, the 3x3 boxes are replaced by 9 regions; regions[cell] is the region (0..8) of each cell
+        void setRegions(const vector<int>& regions);
+        // killer, distinct digits of the cells add up to sum
+        void addCage(const vector<int>& cells, int sum);
+        void addUnit(const vector<int>& cells, int sum = 0);
+
+        int getNumUnits() const {return (int)units.size();};
+        const Unit& getUnit(int unit) const {return units[unit];};
+        // units that contain the cell
+        const int* unitsBegin(int cell) const {return &cellUnits[cellUnitOffsets[cell]];};
+        const int* unitsEnd(int cell) const {return &cellUnits[0] + cellUnitOffsets[cell + 1];};
+        // cells that share at least one unit with the cell
+        const vector<int>& getPeers(int cell) const {return peers[cell];};
+        // true if any unit of the cell has a sum
+        bool hasSumUnit(int cell) const {return sumCells[cell];};
+        bool isClassic() const {return classicRules;};
+
+        // digits that can still be placed in a sum unit in which the digits of usedMask, adding up to
+        // usedSum, are placed already
+        int sumCandidates(int unit, int usedMask, int usedSum) const;
+        // values holds the digits of all cells (row-major), anything outside of 1..9 is empty
+        bool isValid(const int values[nCells]) const;
+
+    private:
+        vector<Unit> units;
+        bool classicRules{true};
+
+        // compiled tables
+        vector<int> cellUnitOffsets;
+        vector<int> cellUnits;
+        vector<vector<int> > peers;
+        vector<char> sumCells;
+
+        void compile();
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,68 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * Stage-level tracing. TRACE_SCOPE("name") records how long the enclosing scope took into a
+ * ring buffer of the current thread. The spans can be exported as Chrome / Perfetto trace JSON
+ * (chrome://tracing, ui.perfetto.dev) or aggregated per name.
+ *
+ * Only compiled in when SUDOKU_TRACE is defined (cmake -DSUDOKU_TRACE=ON), otherwise
+ * TRACE_SCOPE expands to nothing.
+ */
+class Trace{
+
+    public:
+#ifdef SUDOKU_TRACE
+        static constexpr bool enabled = true;
+#else
+        static constexpr bool enabled = false;
+#endif
+        // spans kept per thread, older ones are overwritten
+        static const size_t bufferCapacity = 1 << 16;
+
+        // ns since the start of the process
+        static int64_t now(){
+            return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+        }
+        // name has to outlive the trace, string literals are fine
+        static void record(const char* name, int64_t start, int64_t duration);
+
+        // call these once the traced work is done, they do not synchronize with running spans
+        static bool writeChromeTrace(const string& path);
+        static void printSummary(ostream& out);
+        static void clear();
+
+    private:
+        static const chrono::steady_clock::time_point epoch;
+};
+
+class TraceSpan{
+
+    public:
+        explicit TraceSpan(const char* name): name(name), start(Trace::now()) {};
+        ~TraceSpan(){ Trace::record(name, start, Trace::now() - start); };
+
+        TraceSpan(TraceSpan const&) = delete;
+        void operator=(TraceSpan const&) = delete;
+
+    private:
+        const char* name;
+        int64_t start;
+};
+
+#ifdef SUDOKU_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#endif
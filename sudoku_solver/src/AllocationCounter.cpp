@@ -0,0 +1,50 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+using namespace cv;
+
+static atomic<size_t> nMatAllocations{0};
+static atomic<size_t> nHeapAllocations{0};
+
+// forwards everything to the standard allocator, which also frees the buffers
+class CountingMatAllocator: public MatAllocator{
+
+    public:
+        UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           AccessFlag flags, UMatUsageFlags usageFlags) const override{
+            // user provided data is only wrapped
+            if(!data) nMatAllocations++;
+            return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        }
+
+        bool allocate(UMatData* data, AccessFlag accessFlags, UMatUsageFlags usageFlags) const override{
+            return Mat::getStdAllocator()->allocate(data, accessFlags, usageFlags);
+        }
+
+        void deallocate(UMatData* data) const override{
+            Mat::getStdAllocator()->deallocate(data);
+        }
+};
+
+void AllocationCounter::countMatAllocations(){
+    static once_flag installed;
+    call_once(installed, [](){
+        static CountingMatAllocator allocator;
+        Mat::setDefaultAllocator(&allocator);
+    });
+}
+
+size_t AllocationCounter::matAllocations(){
+    return nMatAllocations;
+}
+
+void AllocationCounter::countHeapAllocation(){
+    nHeapAllocations++;
+}
+
+size_t AllocationCounter::heapAllocations(){
+    return nHeapAllocations;
+}
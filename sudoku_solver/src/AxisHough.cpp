@@ -0,0 +1,136 @@
+#include "AxisHough.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+// number of edge points whose rho is computed in one go before the votes are scattered
+static const int voteBlockSize = 256;
+
+AxisHough::AxisHough(double rho, double theta, double angleWindowDeg)
+    : rhoStep(rho), thetaStep(theta), angleWindowDeg(angleWindowDeg){
+    buildAngleTable();
+}
+
+void AxisHough::setAngleWindow(double angleWindowDeg){
+    if(angleWindowDeg == this->angleWindowDeg) return;
+    this->angleWindowDeg = angleWindowDeg;
+    buildAngleTable();
+}
+
+void AxisHough::buildAngleTable(){
+    /**
+     * Keeps only the angles within angleWindowDeg of 0, 90 and 180 degrees (the same ones that
+     * ImgProc::isHorizontalOrVertical accepts). Windows are separated by a zero row so that
+     * the non-maximum suppression never compares votes across two different windows.
+     */
+    angleRows.clear();
+    const AngleRow padding = {0.f, 0.f, 0.f, false};
+    angleRows.push_back(padding);
+
+    int numAngle = cvRound(CV_PI / thetaStep);
+    float irho = 1.f / (float)rhoStep;
+    for(int n = 0; n < numAngle; n++){
+        double theta = n * thetaStep;
+        double deg = theta / CV_PI * 180.0;
+        bool inWindow = deg < angleWindowDeg || deg > 180 - angleWindowDeg || abs(deg - 90) < angleWindowDeg;
+        if(inWindow){
+            angleRows.push_back({(float)theta, (float)cos(theta) * irho, (float)sin(theta) * irho, true});
+        } else if(angleRows.back().valid){
+            angleRows.push_back(padding);
+        }
+    }
+    if(angleRows.back().valid) angleRows.push_back(padding);
+}
+
+void AxisHough::collectEdgePoints(const Mat& img){
+    pointsX.clear();
+    pointsY.clear();
+    for(int y = 0; y < img.rows; y++){
+        const uchar* row = img.ptr<uchar>(y);
+        for(int x = 0; x < img.cols; x++){
+            if(row[x]){
+                pointsX.push_back((float)x);
+                pointsY.push_back((float)y);
+            }
+        }
+    }
+}
+
+void AxisHough::vote(int numRho){
+    const int nPoints = (int)pointsX.size();
+    const int nRows = (int)angleRows.size();
+    const int stride = numRho + 2;
+    // shifts rho to a positive index, +0.5 turns the truncation below into rounding
+    const float offset = (float)((numRho - 1) / 2) + 0.5f;
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int n = 0; n < nRows; n++){
+        const AngleRow row = angleRows[n];
+        if(!row.valid) continue;
+
+        int* accRow = accumulator.data() + n * stride + 1;
+        int rhoIdx[voteBlockSize];
+        for(int start = 0; start < nPoints; start += voteBlockSize){
+            const int len = min(voteBlockSize, nPoints - start);
+            const float* xs = pointsX.data() + start;
+            const float* ys = pointsY.data() + start;
+
+            // branch-free so that the compiler vectorizes it
+            #pragma omp simd
+            for(int i = 0; i < len; i++){
+                rhoIdx[i] = (int)(xs[i] * row.cosT + ys[i] * row.sinT + offset);
+            }
+            for(int i = 0; i < len; i++){
+                accRow[rhoIdx[i]]++;
+            }
+        }
+    }
+}
+
+void AxisHough::suppressNonMaxima(int numRho, int threshold){
+    // same 4-neighbourhood local maximum test as cv::HoughLines
+    const int stride = numRho + 2;
+    const int* acc = accumulator.data();
+    peaks.clear();
+    for(int n = 0; n < (int)angleRows.size(); n++){
+        if(!angleRows[n].valid) continue;
+        for(int r = 0; r < numRho; r++){
+            int base = n * stride + r + 1;
+            if(acc[base] > threshold &&
+               acc[base] > acc[base - 1] && acc[base] >= acc[base + 1] &&
+               acc[base] > acc[base - stride] && acc[base] >= acc[base + stride]){
+                peaks.push_back(base);
+            }
+        }
+    }
+
+    // strongest lines first
+    sort(peaks.begin(), peaks.end(), [acc](int left, int right) {
+        return acc[left] > acc[right] || (acc[left] == acc[right] && left < right);
+    });
+}
+
+void AxisHough::detect(const Mat& img, vector<Vec2f>& lines, int threshold){
+    TRACE_SCOPE("AxisHough::detect");
+    CV_Assert(img.type() == CV_8UC1);
+
+    const int numRho = cvRound(((img.cols + img.rows) * 2 + 1) / rhoStep);
+    const int stride = numRho + 2;
+    accumulator.assign(angleRows.size() * stride, 0);
+
+    collectEdgePoints(img);
+    vote(numRho);
+    suppressNonMaxima(numRho, threshold);
+
+    lines.clear();
+    for(int idx: peaks){
+        int n = idx / stride;
+        int r = idx - n * stride - 1;
+        float rho = (r - (numRho - 1) * 0.5f) * (float)rhoStep;
+        lines.emplace_back(rho, angleRows[n].theta);
+    }
+}
@@ -0,0 +1,275 @@
+#include "BatchPipeline.hpp"
+#include "Pipeline.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <omp.h>
+
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+using namespace std;
+using namespace cv;
+
+// helpers
+static long elapsedMicros(chrono::steady_clock::time_point start){
+    return (long)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+static bool isImageFile(const string& path){
+    string ext = path.substr(path.find_last_of('.') + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp" || ext == "tif" || ext == "tiff";
+}
+
+static int decodeFlag(int reduction){
+    switch(reduction){
+        case 2: return IMREAD_REDUCED_GRAYSCALE_2;
+        case 4: return IMREAD_REDUCED_GRAYSCALE_4;
+        case 8: return IMREAD_REDUCED_GRAYSCALE_8;
+        default: return IMREAD_GRAYSCALE;
+    }
+}
+
+static string gridString(const Sudoku& game){
+    string res;
+    for(int row=0; row<Sudoku::N; row++)
+        for(int col=0; col<Sudoku::N; col++)
+            res += game.getValue(row, col) == UNASSIGNED ? '.' : (char)('0' + game.getValue(row, col));
+    return res;
+}
+
+// members
+BatchPipeline::BatchPipeline(const BatchOptions& options, MnistModel& model)
+    : options(options), model(model),
+      visionQueue(options.queueCapacity), recognitionQueue(options.queueCapacity),
+      solverQueue(options.queueCapacity), writerQueue(options.queueCapacity){
+}
+
+string BatchPipeline::jsonEscape(const string& text){
+    string res;
+    for(char c: text){
+        switch(c){
+            case '"': res += "\\\""; break;
+            case '\\': res += "\\\\"; break;
+            case '\n': res += "\\n"; break;
+            case '\r': res += "\\r"; break;
+            case '\t': res += "\\t"; break;
+            default:
+                if((unsigned char)c < 0x20){
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                    res += escaped;
+                } else{
+                    res += c;
+                }
+        }
+    }
+    return res;
+}
+
+vector<string> BatchPipeline::listImages(const string& input){
+    vector<string> paths;
+    struct stat info;
+    if(stat(input.c_str(), &info) != 0){
+        cerr << "Cannot open " << input << endl;
+        throw exception();
+    }
+
+    if(S_ISDIR(info.st_mode)){
+        DIR* dir = opendir(input.c_str());
+        if(!dir){
+            cerr << "Cannot read directory " << input << ": " << strerror(errno) << endl;
+            throw exception();
+        }
+        while(dirent* entry = readdir(dir)){
+            string path = input + "/" + entry->d_name;
+            if(isImageFile(path)) paths.push_back(path);
+        }
+        closedir(dir);
+        sort(paths.begin(), paths.end());
+    } else{
+        // manifest with one path per line
+        ifstream manifest(input);
+        string line;
+        while(getline(manifest, line)){
+            if(!line.empty()) paths.push_back(line);
+        }
+    }
+    return paths;
+}
+
+void BatchPipeline::readImages(const vector<string>& paths){
+    int flag = decodeFlag(options.decodeReduction);
+    for(size_t i=0; i<paths.size(); i++){
+        auto start = chrono::steady_clock::now();
+        JobPtr job(new Job());
+        job->index = i;
+        job->path = paths[i];
+        {
+            TRACE_SCOPE("imread");
+            job->img = imread(paths[i], flag);
+        }
+        if(job->img.empty()) job->error = "cannot read image";
+        readTime += elapsedMicros(start);
+        visionQueue.push(move(job));
+    }
+    visionQueue.close();
+}
+
+void BatchPipeline::processImages(atomic<int>& running){
+    // images are processed concurrently already, no need for nested parallel regions
+    omp_set_num_threads(1);
+
+    JobPtr job;
+    while(visionQueue.pop(job)){
+        auto start = chrono::steady_clock::now();
+        if(job->error.empty()){
+            try{
+                ImgProc processor(job->img, options.imgProcParams);
+                processor.run();
+                CellReader::clean(processor, job->cells);
+                job->digits = CellReader::digitImages(processor, job->cells);
+            } catch(exception&){
+                job->error = "no sudoku grid found";
+            }
+        }
+        job->img.release();
+        visionTime += elapsedMicros(start);
+        recognitionQueue.push(move(job));
+    }
+    if(--running == 0) recognitionQueue.close();
+}
+
+void BatchPipeline::recognizeDigits(){
+    vector<JobPtr> jobs;
+    // a model that cannot be loaded fails every batch, it is only tried once
+    string modelError;
+    while(recognitionQueue.popUpTo(jobs, options.recognitionBatch)){
+        auto start = chrono::steady_clock::now();
+
+        // digits of all images go through the net together
+        vector<Mat> digits;
+        for(auto& job: jobs){
+            digits.insert(digits.end(), job->digits.begin(), job->digits.end());
+        }
+        /**
+         * An exception must not leave this thread (std::terminate would end the whole batch), and
+         * the queues have to keep moving so that the other stages do not block on them: the jobs
+         * of a failed batch get the error and go on to the writer.
+         */
+        vector<vector<pair<int, float> > > recognized;
+        if(!digits.empty() && modelError.empty()){
+            try{
+                recognized = model.inferClasses(digits);
+            } catch(exception& e){
+                modelError = string("digit recognition failed: ") + e.what();
+                cerr << modelError << endl;
+            }
+        }
+        size_t offset = 0;
+        for(auto& job: jobs){
+            if(!job->digits.empty() && !modelError.empty()){
+                if(job->error.empty()) job->error = modelError;
+            } else if(!job->digits.empty()){
+                CellReader::assign(job->cells, recognized.data() + offset);
+                offset += job->digits.size();
+            }
+            job->digits.clear();
+        }
+        recognitionTime += elapsedMicros(start);
+
+        for(auto& job: jobs){
+            solverQueue.push(move(job));
+        }
+        jobs.clear();
+    }
+    solverQueue.close();
+}
+
+void BatchPipeline::solveGames(atomic<int>& running){
+    JobPtr job;
+    while(solverQueue.pop(job)){
+        auto start = chrono::steady_clock::now();
+        if(job->error.empty()){
+            vector<Sudoku> possibleGames = CellReader::candidateGames(job->cells);
+            job->nCandidates = possibleGames.size();
+            job->solved = solveCandidates(possibleGames, 1, options.solverBackend);
+        }
+        solverTime += elapsedMicros(start);
+        writerQueue.push(move(job));
+    }
+    if(--running == 0) writerQueue.close();
+}
+
+string BatchPipeline::toJson(const Job& job){
+    stringstream json;
+    json << "{\"index\": " << job.index << ", \"image\": \"" << jsonEscape(job.path) << "\"";
+    if(!job.error.empty()){
+        json << ", \"error\": \"" << jsonEscape(job.error) << "\"}";
+        return json.str();
+    }
+
+    string digits(CellReader::nCells, '.');
+    for(auto& cell: job.cells){
+        if(cell.hasDigit() && !cell.candidates.empty()) digits[cell.row * Sudoku::N + cell.col] = (char)('0' + cell.candidates[0].first);
+    }
+    json << ", \"digits\": \"" << digits << "\", \"candidates\": " << job.nCandidates << ", \"solutions\": [";
+    for(size_t i=0; i<job.solved.size(); i++){
+        json << (i == 0 ? "" : ", ") << "\"" << gridString(job.solved[i]) << "\"";
+    }
+    json << "]}";
+    return json.str();
+}
+
+void BatchPipeline::writeResults(ostream& results, size_t& nWritten, size_t& nSolved){
+    JobPtr job;
+    while(writerQueue.pop(job)){
+        results << toJson(*job) << "\n";
+        nWritten++;
+        if(!job->solved.empty()) nSolved++;
+    }
+    results.flush();
+}
+
+void BatchPipeline::run(const string& input, ostream& results){
+    // without a worker of every stage nothing closes the queue of the next one and run() never returns
+    if(options.visionWorkers < 1 || options.solverWorkers < 1){
+        cerr << "The batch pipeline needs at least one vision and one solver worker" << endl;
+        throw exception();
+    }
+    vector<string> paths = listImages(input);
+    cerr << "Processing " << paths.size() << " images..." << endl;
+    auto start = chrono::steady_clock::now();
+
+    atomic<int> runningVision(options.visionWorkers);
+    atomic<int> runningSolvers(options.solverWorkers);
+    vector<thread> threads;
+    threads.emplace_back(&BatchPipeline::readImages, this, cref(paths));
+    for(int i=0; i<options.visionWorkers; i++){
+        threads.emplace_back(&BatchPipeline::processImages, this, ref(runningVision));
+    }
+    threads.emplace_back(&BatchPipeline::recognizeDigits, this);
+    for(int i=0; i<options.solverWorkers; i++){
+        threads.emplace_back(&BatchPipeline::solveGames, this, ref(runningSolvers));
+    }
+
+    size_t nWritten = 0, nSolved = 0;
+    writeResults(results, nWritten, nSolved);
+    for(auto& t: threads) t.join();
+
+    double seconds = elapsedMicros(start) / 1e6;
+    cerr << "Processed " << nWritten << " images (" << nSolved << " solved) in " << seconds << " s: "
+         << nWritten / seconds << " images/s" << endl;
+    // busy times larger than the wall time mean that the stages overlapped
+    cerr << "Busy time per stage [s]: read " << readTime / 1e6 << ", vision " << visionTime / 1e6
+         << ", recognition " << recognitionTime / 1e6 << ", solve " << solverTime / 1e6 << endl;
+}
@@ -0,0 +1,427 @@
+#include "CdclSolver.hpp"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+
+// helpers
+static const double activityDecay = 0.95;
+// conflicts between restarts are this times the Luby sequence
+static const int restartUnit = 100;
+
+// members
+CdclSolver::CdclSolver(const SudokuRules& rules, const Deadline* deadline): rules(rules), deadline(deadline){
+    for(int u = 0; u < rules.getNumUnits(); u++) hasSums = hasSums || rules.getUnit(u).sum;
+}
+
+int CdclSolver::lubySequence(int i){
+    // 1, 1, 2, 1, 1, 2, 4, 1, 1, 2, 1, 1, 2, 4, 8, ...
+    int size = 1, exponent = 0;
+    while(size < i + 1){
+        exponent++;
+        size = 2 * size + 1;
+    }
+    while(size - 1 != i){
+        size = (size - 1) >> 1;
+        exponent--;
+        i = i % size;
+    }
+    return 1 << exponent;
+}
+
+void CdclSolver::encode(){
+    const int nVars = SudokuRules::nCells * SudokuRules::N;
+    clauses.clear();
+    watches.assign(2 * nVars, vector<int>());
+    assigns.assign(nVars, -1);
+    levels.assign(nVars, 0);
+    reasons.assign(nVars, -1);
+    activity.assign(nVars, 0);
+    seen.assign(nVars, 0);
+    trail.clear();
+    trailLimits.clear();
+    propagated = 0;
+    activityIncrement = 1;
+    stats = Stats();
+
+    /**
+     * "At most one digit per cell" and "peers hold different digits" are binary clauses that
+     * propagateClauses() applies directly whenever a digit is placed, only the "at least one"
+     * clauses are stored.
+     */
+    vector<int> lits;
+    for(int cell = 0; cell < SudokuRules::nCells; cell++){
+        lits.clear();
+        for(int digit = 1; digit <= SudokuRules::N; digit++) lits.push_back(literal(variable(cell, digit), false));
+        addClause(lits, false);
+    }
+    for(int u = 0; u < rules.getNumUnits(); u++){
+        const SudokuRules::Unit& unit = rules.getUnit(u);
+        if((int)unit.cells.size() != SudokuRules::N) continue;
+        for(int digit = 1; digit <= SudokuRules::N; digit++){
+            lits.clear();
+            for(int cell: unit.cells) lits.push_back(literal(variable(cell, digit), false));
+            addClause(lits, false);
+        }
+    }
+}
+
+int CdclSolver::addClause(const vector<int>& lits, bool isLearnt){
+    // watch the literals that are not false, then the false ones assigned last
+    Clause clause{lits, isLearnt};
+    auto watchOrder = [this](int lit){return value(lit) != 0 ? INT_MAX : levels[lit >> 1];};
+    partial_sort(clause.lits.begin(), clause.lits.begin() + min<size_t>(2, lits.size()), clause.lits.end(),
+                 [&](int a, int b){return watchOrder(a) > watchOrder(b);});
+    int index = (int)clauses.size();
+    watches[clause.lits[0]].push_back(index);
+    watches[clause.lits[1]].push_back(index);
+    clauses.push_back(move(clause));
+    return index;
+}
+
+bool CdclSolver::addUnit(int lit){
+    if(value(lit) == 0) return false;
+    if(value(lit) < 0) assign(lit, -1);
+    return true;
+}
+
+void CdclSolver::assign(int lit, int reason){
+    int var = lit >> 1;
+    assigns[var] = !(lit & 1);
+    levels[var] = decisionLevel();
+    reasons[var] = reason;
+    trail.push_back(lit);
+}
+
+bool CdclSolver::assignFalse(int var, int placed){
+    int lit = literal(var, true);
+    int v = value(lit);
+    if(v == 1) return true;
+    if(v == 0){
+        conflict.assign({placed ^ 1, lit});
+        return false;
+    }
+    // implied by the binary clause (not placed, not var)
+    assign(lit, binaryReason(placed ^ 1));
+    stats.propagations++;
+    return true;
+}
+
+bool CdclSolver::propagate(){
+    while(true){
+        if(propagateClauses()) return true;
+        if(!hasSums) return false;
+        size_t assigned = trail.size();
+        if(propagateSums()) return true;
+        if(trail.size() == assigned) return false;
+    }
+}
+
+bool CdclSolver::propagateClauses(){
+    while(propagated < trail.size()){
+        int placed = trail[propagated++];
+        if(!(placed & 1)){
+            // a digit was placed, no other digit in its cell and not the same digit in its peers
+            int var = placed >> 1;
+            int cell = var / SudokuRules::N, digit = var % SudokuRules::N + 1;
+            for(int d = 1; d <= SudokuRules::N; d++){
+                if(d != digit && !assignFalse(variable(cell, d), placed)) return true;
+            }
+            for(int peer: rules.getPeers(cell)){
+                if(!assignFalse(variable(peer, digit), placed)) return true;
+            }
+        }
+
+        // two watched literals: only clauses watching the literal that just became false are visited
+        int falseLit = placed ^ 1;
+        vector<int>& watching = watches[falseLit];
+        size_t kept = 0, i = 0;
+        while(i < watching.size()){
+            int index = watching[i++];
+            vector<int>& lits = clauses[index].lits;
+            if(lits[0] == falseLit) swap(lits[0], lits[1]);
+            if(value(lits[0]) == 1){
+                watching[kept++] = index;
+                continue;
+            }
+            bool moved = false;
+            for(size_t k = 2; k < lits.size() && !moved; k++){
+                if(value(lits[k]) != 0){
+                    swap(lits[1], lits[k]);
+                    watches[lits[1]].push_back(index);
+                    moved = true;
+                }
+            }
+            if(moved) continue;
+
+            watching[kept++] = index;
+            if(value(lits[0]) == 0){
+                while(i < watching.size()) watching[kept++] = watching[i++];
+                watching.resize(kept);
+                conflict = lits;
+                return true;
+            }
+            assign(lits[0], index);
+            stats.propagations++;
+        }
+        watching.resize(kept);
+    }
+    return false;
+}
+
+bool CdclSolver::propagateSums(){
+    /**
+     * Lazily generated clauses: the digits placed in a sum unit rule out the digits that no
+     * longer fit into any combination, explained by (not placed_1 or ... or not placed_k or not x).
+     */
+    vector<int>& lits = sumLits;
+    for(int u = 0; u < rules.getNumUnits(); u++){
+        const SudokuRules::Unit& unit = rules.getUnit(u);
+        if(!unit.sum) continue;
+        int usedMask = 0, usedSum = 0, nFree = 0;
+        lits.assign(1, 0);
+        for(int cell: unit.cells){
+            int digit = placedDigit(cell);
+            if(digit){
+                usedMask |= 1 << (digit - 1);
+                usedSum += digit;
+                lits.push_back(literal(variable(cell, digit), true));
+            }
+            else nFree++;
+        }
+        int allowed = nFree ? rules.sumCandidates(u, usedMask, usedSum) : 0;
+        if(nFree ? allowed == 0 : usedSum != unit.sum){
+            // no digits placed at all is ruled out before the search
+            conflict.assign(lits.begin() + 1, lits.end());
+            return true;
+        }
+        if(!nFree) continue;
+
+        for(int cell: unit.cells){
+            for(int digit = 1; digit <= SudokuRules::N; digit++){
+                int var = variable(cell, digit);
+                if((allowed & (1 << (digit - 1))) || assigns[var] >= 0) continue;
+                lits[0] = literal(var, true);
+                if(lits.size() == 1){
+                    // holds regardless of the other cells, only happens at level 0
+                    assign(lits[0], -1);
+                }
+                else{
+                    assign(lits[0], addClause(lits, true));
+                }
+                stats.propagations++;
+            }
+        }
+    }
+    return false;
+}
+
+int CdclSolver::placedDigit(int cell) const{
+    for(int digit = 1; digit <= SudokuRules::N; digit++)
+        if(assigns[variable(cell, digit)] == 1) return digit;
+    return 0;
+}
+
+void CdclSolver::analyze(int& backjumpLevel){
+    /**
+     * Resolves the conflict with the reasons of its literals of the current level, in reverse
+     * trail order, until a single literal of that level is left (first unique implication point).
+     */
+    learnt.assign(1, 0);
+    int pathCount = 0;
+    int placed = -1;
+    int index = (int)trail.size() - 1;
+    int binaryLit = 0;
+    const int* lits = conflict.data();
+    size_t nLits = conflict.size();
+    while(true){
+        for(size_t i = 0; i < nLits; i++){
+            int var = lits[i] >> 1;
+            if((placed >= 0 && var == (placed >> 1)) || seen[var] || levels[var] == 0) continue;
+            seen[var] = 1;
+            bumpActivity(var);
+            if(levels[var] >= decisionLevel()) pathCount++;
+            else learnt.push_back(lits[i]);
+        }
+        while(!seen[trail[index] >> 1]) index--;
+        placed = trail[index--];
+        seen[placed >> 1] = 0;
+        if(--pathCount == 0) break;
+
+        int reason = reasons[placed >> 1];
+        if(reason >= 0){
+            lits = clauses[reason].lits.data();
+            nLits = clauses[reason].lits.size();
+        }
+        else{
+            binaryLit = binaryReasonLiteral(reason);
+            lits = &binaryLit;
+            nLits = 1;
+        }
+    }
+    learnt[0] = placed ^ 1;
+
+    // drop literals implied by the other ones
+    toClear.assign(learnt.begin() + 1, learnt.end());
+    size_t kept = 1;
+    for(size_t i = 1; i < learnt.size(); i++){
+        int var = learnt[i] >> 1;
+        int reason = reasons[var];
+        bool redundant = reason != -1;
+        if(reason >= 0){
+            for(int lit: clauses[reason].lits){
+                int other = lit >> 1;
+                if(other != var && !seen[other] && levels[other] > 0) redundant = false;
+            }
+        }
+        else if(redundant){
+            int other = binaryReasonLiteral(reason) >> 1;
+            redundant = seen[other] || levels[other] == 0;
+        }
+        if(!redundant) learnt[kept++] = learnt[i];
+    }
+    learnt.resize(kept);
+    for(int lit: toClear) seen[lit >> 1] = 0;
+
+    // jump back to the second highest level, where the learned clause becomes unit
+    backjumpLevel = 0;
+    for(size_t i = 1; i < learnt.size(); i++){
+        if(levels[learnt[i] >> 1] > backjumpLevel){
+            backjumpLevel = levels[learnt[i] >> 1];
+            swap(learnt[1], learnt[i]);
+        }
+    }
+}
+
+void CdclSolver::backtrack(int level){
+    if(decisionLevel() <= level) return;
+    for(int i = (int)trail.size() - 1; i >= trailLimits[level]; i--){
+        int var = trail[i] >> 1;
+        assigns[var] = -1;
+        reasons[var] = -1;
+    }
+    trail.resize(trailLimits[level]);
+    trailLimits.resize(level);
+    propagated = trail.size();
+}
+
+void CdclSolver::bumpActivity(int var){
+    activity[var] += activityIncrement;
+    if(activity[var] > 1e100){
+        for(auto& a: activity) a *= 1e-100;
+        activityIncrement *= 1e-100;
+    }
+}
+
+int CdclSolver::pickBranchVariable() const{
+    // most active unassigned variable, ties go to the cell with the fewest digits left
+    int best = -1, bestFree = SudokuRules::N + 1;
+    double bestActivity = -1;
+    for(int cell = 0; cell < SudokuRules::nCells; cell++){
+        int nFree = 0;
+        for(int digit = 1; digit <= SudokuRules::N; digit++) nFree += assigns[variable(cell, digit)] < 0;
+        if(!nFree) continue;
+        for(int digit = 1; digit <= SudokuRules::N; digit++){
+            int var = variable(cell, digit);
+            if(assigns[var] >= 0) continue;
+            if(activity[var] > bestActivity || (activity[var] == bestActivity && nFree < bestFree)){
+                best = var;
+                bestActivity = activity[var];
+                bestFree = nFree;
+            }
+        }
+    }
+    return best;
+}
+
+void CdclSolver::reduce(){
+    size_t nLearnts = 0;
+    for(auto& clause: clauses) nLearnts += clause.learnt;
+    if(nLearnts < maxLearnts) return;
+    maxLearnts = maxLearnts * 11 / 10;
+
+    // the longer half of the learned clauses goes
+    vector<size_t> lengths;
+    for(auto& clause: clauses)
+        if(clause.learnt) lengths.push_back(clause.lits.size());
+    nth_element(lengths.begin(), lengths.begin() + lengths.size() / 2, lengths.end());
+    size_t maxLength = max<size_t>(lengths[lengths.size() / 2], 2);
+
+    vector<Clause> kept;
+    for(auto& clause: clauses){
+        if(clause.learnt && clause.lits.size() > maxLength) continue;
+        bool satisfied = false;
+        for(int lit: clause.lits) satisfied = satisfied || value(lit) == 1;
+        if(satisfied) continue;
+        // at level 0 the false literals stay false, at least two literals are left after propagation
+        clause.lits.erase(remove_if(clause.lits.begin(), clause.lits.end(), [this](int lit){return value(lit) == 0;}),
+                          clause.lits.end());
+        kept.push_back(move(clause));
+    }
+    clauses = move(kept);
+    for(auto& watching: watches) watching.clear();
+    for(size_t i = 0; i < clauses.size(); i++){
+        watches[clauses[i].lits[0]].push_back((int)i);
+        watches[clauses[i].lits[1]].push_back((int)i);
+    }
+    // only level 0 is assigned, its reasons are never looked at
+    fill(reasons.begin(), reasons.end(), -1);
+}
+
+bool CdclSolver::solve(int values[SudokuRules::nCells]){
+    encode();
+    for(int u = 0; u < rules.getNumUnits(); u++){
+        if(rules.getUnit(u).sum && !rules.sumCandidates(u, 0, 0)) return false;
+    }
+    for(int cell = 0; cell < SudokuRules::nCells; cell++){
+        bool given = values[cell] >= 1 && values[cell] <= SudokuRules::N;
+        if(given && !addUnit(literal(variable(cell, values[cell]), false))) return false;
+    }
+
+    int nRestarts = 0;
+    long conflictsLeft = restartUnit * lubySequence(0);
+    while(true){
+        if(propagate()){
+            stats.conflicts++;
+            int conflictLevel = 0;
+            for(int lit: conflict) conflictLevel = max(conflictLevel, levels[lit >> 1]);
+            if(conflictLevel == 0) return false;
+            backtrack(conflictLevel);
+
+            int backjumpLevel;
+            analyze(backjumpLevel);
+            backtrack(backjumpLevel);
+            if(learnt.size() == 1){
+                assign(learnt[0], -1);
+            }
+            else{
+                assign(learnt[0], addClause(learnt, true));
+                stats.learnedClauses++;
+            }
+            activityIncrement /= activityDecay;
+            conflictsLeft--;
+            continue;
+        }
+
+        if(conflictsLeft <= 0){
+            backtrack(0);
+            reduce();
+            stats.restarts++;
+            conflictsLeft = restartUnit * lubySequence(++nRestarts);
+        }
+
+        int var = pickBranchVariable();
+        if(var < 0) break; // every cell has its digit
+        stats.decisions++;
+        if(deadline && stats.decisions % Deadline::checkInterval == 0 && deadline->expired()){
+            stopped = true;
+            return false;
+        }
+        trailLimits.push_back((int)trail.size());
+        assign(literal(var, false), -1);
+    }
+
+    for(int cell = 0; cell < SudokuRules::nCells; cell++) values[cell] = placedDigit(cell);
+    return true;
+}
@@ -0,0 +1,100 @@
+#include "CellCleaner.hpp"
+#include "Trace.hpp"
+
+#include <cstring>
+
+using namespace std;
+using namespace cv;
+
+void CellCleaner::encodeRuns(const Mat& binaryImg){
+    runs.clear();
+    for(int y = 0; y < binaryImg.rows; y++){
+        const uchar* row = binaryImg.ptr<uchar>(y);
+        int x = 0;
+        while(x < binaryImg.cols){
+            if(!row[x]){
+                x++;
+                continue;
+            }
+            int start = x;
+            while(x < binaryImg.cols && row[x]) x++;
+            runs.push_back({y, start, x});
+        }
+    }
+}
+
+int CellCleaner::findRoot(int run){
+    while(parent[run] != run){
+        // path halving
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+void CellCleaner::unite(int run1, int run2){
+    int root1 = findRoot(run1);
+    int root2 = findRoot(run2);
+    // the smaller index stays the root, so roots are always the first run of their component
+    if(root1 < root2) parent[root2] = root1;
+    else if(root2 < root1) parent[root1] = root2;
+}
+
+void CellCleaner::linkRuns(){
+    /**
+     * Runs are sorted by row and start, so the overlapping runs of two consecutive rows are
+     * found with a single sweep. Two runs are 4-connected if their column ranges overlap.
+     */
+    const int nRuns = (int)runs.size();
+    parent.resize(nRuns);
+    for(int i = 0; i < nRuns; i++) parent[i] = i;
+
+    int prevBegin = 0, prevEnd = 0;
+    int i = 0;
+    while(i < nRuns){
+        int row = runs[i].row;
+        int curBegin = i;
+        while(i < nRuns && runs[i].row == row) i++;
+        int curEnd = i;
+
+        if(prevEnd > prevBegin && runs[prevBegin].row == row - 1){
+            int p = prevBegin, c = curBegin;
+            while(p < prevEnd && c < curEnd){
+                if(runs[p].start < runs[c].end && runs[c].start < runs[p].end) unite(p, c);
+                // advance whichever run ends first, it cannot overlap anything further right
+                if(runs[p].end < runs[c].end) p++;
+                else c++;
+            }
+        }
+        prevBegin = curBegin;
+        prevEnd = curEnd;
+    }
+}
+
+DigitBlob CellCleaner::clearBorder(Mat& binaryImg){
+    TRACE_SCOPE("removeEdges");
+    CV_Assert(binaryImg.type() == CV_8UC1);
+
+    encodeRuns(binaryImg);
+    linkRuns();
+
+    const int nRuns = (int)runs.size();
+    const int lastRow = binaryImg.rows - 1;
+    touchesBorder.assign(nRuns, 0);
+    for(int i = 0; i < nRuns; i++){
+        const Run& r = runs[i];
+        if(r.row == 0 || r.row == lastRow || r.start == 0 || r.end == binaryImg.cols){
+            touchesBorder[findRoot(i)] = 1;
+        }
+    }
+
+    // clear the border components and count what remains
+    DigitBlob digit;
+    for(int i = 0; i < nRuns; i++){
+        const Run& r = runs[i];
+        int len = r.end - r.start;
+        if(touchesBorder[findRoot(i)]) memset(binaryImg.ptr<uchar>(r.row) + r.start, 0, len);
+        else digit.area += len;
+    }
+    return digit;
+}
@@ -0,0 +1,185 @@
+#include "CellReader.hpp"
+#include "Trace.hpp"
+
+#include <omp.h>
+
+using namespace std;
+using namespace cv;
+
+// helpers
+static void cleanCell(const ImgProc& processor, int grid, int k, CellCleaner& cleaner, CellResult& result,
+                      const Deadline* deadline){
+    result.row = k / Sudoku::N;
+    result.col = k % Sudoku::N;
+    result.candidates.clear();
+    // an omp loop cannot be left early, the remaining cells are skipped instead
+    result.skipped = deadline && deadline->expired();
+    if(result.skipped){
+        result.digit = DigitBlob();
+        return;
+    }
+
+    Mat cell = processor.getBinaryCell(result.row, result.col, grid);
+    result.digit = cleaner.clearBorder(cell);
+}
+
+// appends views of the non-empty cells of one grid to digits
+static void appendDigits(const ImgProc& processor, int grid, const CellReader::CellResults& results,
+                         Mat& digitGrid, vector<Mat>& digits){
+    // single downsample of the whole grid to the input size of the neural-net
+    resize(processor.getBinaryGrid(grid), digitGrid,
+           Size(Sudoku::N * MnistModel::inputSize, Sudoku::N * MnistModel::inputSize), 0, 0, INTER_AREA);
+
+    for(auto& result: results){
+        if(!result.hasDigit()) continue;
+        digits.push_back(digitGrid(ImgProc::cellRect(result.row, result.col, MnistModel::inputSize)));
+    }
+}
+
+// members
+void CellReader::clean(const ImgProc& processor, CellResults& results, const Deadline* deadline){
+    vector<CellCleaner> cleaners;
+    clean(processor, results, cleaners, deadline);
+}
+
+void CellReader::clean(const ImgProc& processor, CellResults& results, vector<CellCleaner>& cleaners,
+                       const Deadline* deadline){
+    TRACE_SCOPE("CellReader::clean");
+    // one cleaner per thread, they keep their scratch buffers for the next call
+    if(cleaners.size() < (size_t)omp_get_max_threads()) cleaners.resize(omp_get_max_threads());
+
+    // cells are views into one buffer and never overlap, so they can be cleaned concurrently
+    #pragma omp parallel
+    {
+        CellCleaner& cleaner = cleaners[omp_get_thread_num()];
+        #pragma omp for schedule(static)
+        for(int k=0; k<nCells; k++){
+            cleanCell(processor, 0, k, cleaner, results[k], deadline);
+        }
+    }
+}
+
+vector<Mat> CellReader::digitImages(const ImgProc& processor, const CellResults& results){
+    Mat digitGrid;
+    vector<Mat> digits;
+    digitImages(processor, results, digitGrid, digits);
+    return digits;
+}
+
+void CellReader::digitImages(const ImgProc& processor, const CellResults& results, Mat& digitGrid, vector<Mat>& digits){
+    TRACE_SCOPE("CellReader::digitImages");
+    digits.clear();
+    appendDigits(processor, 0, results, digitGrid, digits);
+}
+
+void CellReader::assign(CellResults& results, vector<pair<int, float> > const* recognized){
+    for(auto& result: results){
+        if(!result.hasDigit()) continue;
+        // drop zeros since sudoku doesnt have them definitely
+        for(auto& digitWithProb: *recognized){
+            if(digitWithProb.first != 0) result.candidates.push_back(digitWithProb);
+        }
+        recognized++;
+    }
+}
+
+void CellReader::read(const ImgProc& processor, MnistModel& model, CellResults& results, const Deadline* deadline){
+    clean(processor, results, deadline);
+    // the forward pass cannot be interrupted, it only starts with time left
+    if(deadline && deadline->expired()) return;
+    vector<Mat> digits = digitImages(processor, results);
+    if(digits.empty()) return;
+
+    vector<vector<pair<int, float> > > recognized = model.inferClasses(digits);
+    assign(results, recognized.data());
+}
+
+void CellReader::readAll(const ImgProc& processor, MnistModel& model, vector<CellResults>& results,
+                         const Deadline* deadline){
+    TRACE_SCOPE("CellReader::readAll");
+    const int nGrids = processor.getNumGrids();
+    results.resize(nGrids);
+
+    // the cells of all grids in one parallel loop, one cleaner per thread
+    vector<CellCleaner> cleaners(omp_get_max_threads());
+    #pragma omp parallel
+    {
+        CellCleaner& cleaner = cleaners[omp_get_thread_num()];
+        #pragma omp for schedule(static)
+        for(int k=0; k<nGrids * nCells; k++){
+            cleanCell(processor, k / nCells, k % nCells, cleaner, results[k / nCells][k % nCells], deadline);
+        }
+    }
+    if(deadline && deadline->expired()) return;
+
+    // the digits of all grids in a single batch
+    vector<Mat> digitGrids(nGrids);
+    vector<Mat> digits;
+    for(int g=0; g<nGrids; g++) appendDigits(processor, g, results[g], digitGrids[g], digits);
+    if(digits.empty()) return;
+    vector<vector<pair<int, float> > > recognized = model.inferClasses(digits);
+
+    const vector<pair<int, float> >* next = recognized.data();
+    for(auto& grid: results){
+        assign(grid, next);
+        for(auto& result: grid) next += result.hasDigit();
+    }
+}
+
+vector<Sudoku> CellReader::candidateGames(const CellResults& results, const Deadline* deadline){
+    TRACE_SCOPE("candidateGames");
+    vector<Sudoku> possibleGames = vector<Sudoku>();
+    possibleGames.emplace_back();
+
+    for(auto& result: results){
+        // digits that were not recognized before the deadline have no candidates
+        if(!result.hasDigit() || result.candidates.empty()) continue;
+        const vector<pair<int, float> >& recognizedDigits = result.candidates;
+
+        if(result.isDefinitive()){
+            for(auto & possibleGame : possibleGames){
+                possibleGame.fill(result.row, result.col, recognizedDigits[0].first, recognizedDigits[0].second);
+            }
+        } else{
+            /**
+             * Every uncertain cell multiplies the number of games, so the enumeration grows
+             * exponentially. Once the deadline expired, the games only get the most likely digit.
+             */
+            vector<Sudoku> newPossibleGames = vector<Sudoku>();
+            bool branch = true;
+            for(size_t g=0; g<possibleGames.size(); g++){
+                Sudoku& possibleGame = possibleGames[g];
+                if(branch && deadline && g % Deadline::checkInterval == 0) branch = !deadline->expired();
+                for(size_t p=1; branch && p<recognizedDigits.size(); p++){
+                    Sudoku newGame(possibleGame);
+                    newGame.fill(result.row, result.col, recognizedDigits[p].first, recognizedDigits[p].second);
+                    newPossibleGames.emplace_back(move(newGame));
+                }
+                possibleGame.fill(result.row, result.col, recognizedDigits[0].first, recognizedDigits[0].second);
+            }
+            // concat vectors without copy
+            possibleGames.insert(
+                    possibleGames.end(),
+                    make_move_iterator(newPossibleGames.begin()),
+                    make_move_iterator(newPossibleGames.end()));
+        }
+    }
+    return possibleGames;
+}
+
+void CellReader::print(const CellResults& results){
+    for(auto& result: results){
+        if(!result.hasDigit() || result.candidates.empty()) continue;
+        const vector<pair<int, float> >& digits = result.candidates;
+        cout << "(" << result.row << ", " << result.col << ") ";
+        if(result.isDefinitive()){
+            cout << "Definitive digit: " << digits[0].first << " with prob: " << digits[0].second << endl;
+        } else{
+            cout << "Possible digits:";
+            for(size_t p=0; p<digits.size(); p++){
+                cout << (p == 0 ? " " : " and ") << digits[p].first << " (" << digits[p].second << ")";
+            }
+            cout << endl;
+        }
+    }
+}
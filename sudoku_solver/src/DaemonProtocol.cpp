@@ -0,0 +1,57 @@
+#include "DaemonProtocol.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+bool DaemonProtocol::readFully(int fd, void* buffer, size_t size){
+    char* data = (char*)buffer;
+    while(size > 0){
+        ssize_t n = read(fd, data, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool DaemonProtocol::writeFully(int fd, const void* buffer, size_t size){
+    const char* data = (const char*)buffer;
+    while(size > 0){
+        // no SIGPIPE if the other side went away
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool DaemonProtocol::sendRequest(int fd, uint32_t type, uint32_t id, const vector<char>& payload){
+    RequestHeader header = {requestMagic, type, id, (uint32_t)payload.size()};
+    return writeFully(fd, &header, sizeof(header)) && writeFully(fd, payload.data(), payload.size());
+}
+
+bool DaemonProtocol::receiveResponse(int fd, Response& response){
+    return readFully(fd, &response, sizeof(response)) && response.header.magic == responseMagic;
+}
+
+int DaemonProtocol::connectTo(const string& socketPath){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    if(connect(fd, (sockaddr*)&address, sizeof(address)) != 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,90 @@
+#include "Deadline.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+// helpers
+static atomic<long> nRequests{0};
+static atomic<long> nBounded{0};
+static atomic<long> nTimedOut{0};
+static atomic<long> nCancelled{0};
+static atomic<long> nOverruns{0};
+static atomic<long> totalOverrunMicros{0};
+static atomic<long> maxOverrunMicros{0};
+
+// members
+Deadline::Deadline(): start(chrono::steady_clock::now()), end(start){
+}
+
+Deadline::Deadline(double budgetMs): start(chrono::steady_clock::now()), budgetMs(budgetMs), bounded(budgetMs > 0){
+    end = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, milli>(budgetMs));
+}
+
+bool Deadline::expired() const{
+    if(reason.load(memory_order_relaxed) != NONE) return true;
+    int why;
+    if(cancelled.load(memory_order_relaxed)) why = CANCELLED;
+    else if(bounded && chrono::steady_clock::now() >= end) why = TIMEOUT;
+    else return false;
+    // the first reason wins when several threads notice at the same time
+    int none = NONE;
+    reason.compare_exchange_strong(none, why, memory_order_relaxed);
+    return true;
+}
+
+double Deadline::elapsedMs() const{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+double Deadline::overrunMs() const{
+    if(!bounded) return 0;
+    return max(0.0, chrono::duration<double, milli>(chrono::steady_clock::now() - end).count());
+}
+
+const char* Deadline::toString(StopReason reason){
+    switch(reason){
+        case TIMEOUT: return "deadline exceeded";
+        case CANCELLED: return "cancelled";
+        default: return "not stopped";
+    }
+}
+
+void DeadlineMetrics::record(const Deadline& deadline){
+    nRequests++;
+    if(deadline.stopReason() == Deadline::TIMEOUT) nTimedOut++;
+    if(deadline.stopReason() == Deadline::CANCELLED) nCancelled++;
+    if(!deadline.isBounded()) return;
+    nBounded++;
+    long overrun = (long)(deadline.overrunMs() * 1000);
+    if(overrun <= 0) return;
+    nOverruns++;
+    totalOverrunMicros += overrun;
+    long previous = maxOverrunMicros.load();
+    while(overrun > previous && !maxOverrunMicros.compare_exchange_weak(previous, overrun)) {}
+}
+
+DeadlineMetrics::Snapshot DeadlineMetrics::snapshot(){
+    Snapshot result;
+    result.requests = nRequests;
+    result.bounded = nBounded;
+    result.timedOut = nTimedOut;
+    result.cancelled = nCancelled;
+    result.overruns = nOverruns;
+    result.totalOverrunMs = totalOverrunMicros / 1000.0;
+    result.maxOverrunMs = maxOverrunMicros / 1000.0;
+    return result;
+}
+
+void DeadlineMetrics::reset(){
+    nRequests = nBounded = nTimedOut = nCancelled = nOverruns = 0;
+    totalOverrunMicros = maxOverrunMicros = 0;
+}
+
+void DeadlineMetrics::print(ostream& out){
+    Snapshot s = snapshot();
+    out << "Deadlines: " << s.requests << " requests, " << s.bounded << " with a budget, "
+        << s.timedOut << " timed out, " << s.cancelled << " cancelled, "
+        << s.overruns << " overran (" << 100 * s.overrunRate() << "%, mean "
+        << s.meanOverrunMs() << " ms, max " << s.maxOverrunMs << " ms)" << endl;
+}
\ No newline at end of file
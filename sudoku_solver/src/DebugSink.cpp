@@ -0,0 +1,39 @@
+#include "DebugSink.hpp"
+
+#include <cstdio>
+#include <iostream>
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+using namespace std;
+using namespace cv;
+
+DebugSink::DebugSink(const string& directory, size_t capacity)
+    : directory(directory), queue(capacity){
+    writer = thread(&DebugSink::writeImages, this);
+}
+
+DebugSink::~DebugSink(){
+    queue.close();
+    writer.join();
+    if(dropped) cerr << "Dropped " << dropped << " debug images, the writer could not keep up" << endl;
+}
+
+void DebugSink::submit(const string& name, const Mat& img){
+    char prefix[16];
+    {
+        lock_guard<mutex> lock(counterMutex);
+        snprintf(prefix, sizeof(prefix), "%04d_", counter++);
+    }
+    if(queue.tryPush(make_pair(directory + "/" + prefix + name + ".png", img.clone()))) return;
+    lock_guard<mutex> lock(counterMutex);
+    dropped++;
+}
+
+void DebugSink::writeImages(){
+    pair<string, Mat> item;
+    while(queue.pop(item)){
+        if(!imwrite(item.first, item.second)){
+            cerr << "Could not write debug image " << item.first << endl;
+        }
+    }
+}
@@ -0,0 +1,198 @@
+#include "DigitNet.hpp"
+
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+using namespace torch;
+
+// helpers
+static nn::LeakyReLU activation(){
+    return nn::LeakyReLU(nn::LeakyReLUOptions().negative_slope(0.2));
+}
+
+static nn::MaxPool2d pooling(){
+    return nn::MaxPool2d(nn::MaxPool2dOptions({2, 2}).stride({2, 2}));
+}
+
+// members
+vector<int> DigitNetConfig::keptChannels() const{
+    vector<int> kept;
+    for(int c: channels) kept.push_back(max(1, (int)lround(c * (1.0 - pruneRatio))));
+    return kept;
+}
+
+DigitNetConfig DigitNetConfig::unpruned() const{
+    DigitNetConfig config = *this;
+    config.pruneRatio = 0;
+    return config;
+}
+
+string DigitNetConfig::defaultModelPath() const{
+    return name == "baseline" ? "./model.pt" : "./model_" + name + ".pt";
+}
+
+DigitNet::Layout DigitNet::layout(const DigitNetConfig& config){
+    if(config.channels.empty() || config.channels.size() != config.kernels.size()){
+        cerr << "Digit-net " << config.name << " needs one kernel size per convolution" << endl;
+        throw exception();
+    }
+    Layout result;
+    int index = 0, side = config.inputSize;
+    for(size_t l=0; l<config.channels.size(); l++){
+        result.depthwise.push_back(config.separable && l > 0 ? index++ : -1);
+        result.conv.push_back(index++);
+        // activation and pooling
+        index += 2;
+        side = (side - config.kernels[l] + 1) / 2;
+        if(side < 1){
+            cerr << "Input of " << config.inputSize << "x" << config.inputSize << " is too small for digit-net " << config.name << endl;
+            throw exception();
+        }
+    }
+    result.finalSide = side;
+    // flatten and dropout come first
+    result.hidden = index + 2;
+    result.output = index + 4;
+    return result;
+}
+
+nn::Sequential DigitNet::build(const DigitNetConfig& config){
+    Layout layers = layout(config);
+    vector<int> channels = config.keptChannels();
+
+    // the modules are appended in the order of Layout, the baseline has the same modules (and
+    // parameter names) as the net before it was configurable
+    nn::Sequential net;
+    int in = 1;
+    for(size_t l=0; l<channels.size(); l++){
+        int k = config.kernels[l];
+        if(layers.depthwise[l] >= 0){
+            net->push_back(nn::Conv2d(nn::Conv2dOptions(in, in, k).groups(in).bias(false)));
+            net->push_back(nn::Conv2d(nn::Conv2dOptions(in, channels[l], 1).bias(false)));
+        } else{
+            net->push_back(nn::Conv2d(nn::Conv2dOptions(in, channels[l], k).stride(1).padding(0).bias(false)));
+        }
+        net->push_back(activation());
+        net->push_back(pooling());
+        in = channels[l];
+    }
+    net->push_back(nn::Flatten());
+    net->push_back(nn::Dropout(nn::DropoutOptions().p(config.dropout)));
+    net->push_back(nn::Linear(in * layers.finalSide * layers.finalSide, config.hidden));
+    net->push_back(activation());
+    net->push_back(nn::Linear(config.hidden, nClasses));
+    net->push_back(nn::LogSoftmax(nn::LogSoftmaxOptions(1)));
+    return net;
+}
+
+DigitNetCost DigitNet::cost(const DigitNetConfig& config){
+    Layout layers = layout(config);
+    vector<int> channels = config.keptChannels();
+
+    DigitNetCost result;
+    int64_t in = 1, side = config.inputSize;
+    for(size_t l=0; l<channels.size(); l++){
+        int64_t k = config.kernels[l], out = channels[l];
+        // side of the convolution output, before pooling
+        int64_t conv = side - k + 1;
+        if(layers.depthwise[l] >= 0){
+            result.params += in * k * k + in * out;
+            result.macs += (in * k * k + in * out) * conv * conv;
+        } else{
+            result.params += out * in * k * k;
+            result.macs += out * in * k * k * conv * conv;
+        }
+        side = conv / 2;
+        in = out;
+    }
+    int64_t flat = in * side * side;
+    result.params += flat * config.hidden + config.hidden + config.hidden * nClasses + nClasses;
+    result.macs += flat * config.hidden + config.hidden * nClasses;
+    return result;
+}
+
+nn::Sequential DigitNet::prune(nn::Sequential& net, const DigitNetConfig& config){
+    Layout from = layout(config.unpruned());
+    Layout to = layout(config);
+    vector<int> channels = config.keptChannels();
+    nn::Sequential pruned = build(config);
+
+    NoGradGuard noGrad;
+    // kept channels of the previous layer, in ascending order, undefined for the image
+    Tensor previous;
+    for(size_t l=0; l<channels.size(); l++){
+        // out x in x k x k, the channels whose filters have the largest L1 norm are kept
+        Tensor weight = net->ptr<nn::Conv2dImpl>(from.conv[l])->weight;
+        Tensor norms = weight.abs().sum({1, 2, 3});
+        Tensor kept = std::get<0>(std::get<1>(norms.topk(channels[l])).sort());
+
+        if(previous.defined()) weight = weight.index_select(1, previous);
+        pruned->ptr<nn::Conv2dImpl>(to.conv[l])->weight.copy_(weight.index_select(0, kept));
+        if(from.depthwise[l] >= 0){
+            // one filter per input channel
+            Tensor depthwise = net->ptr<nn::Conv2dImpl>(from.depthwise[l])->weight;
+            pruned->ptr<nn::Conv2dImpl>(to.depthwise[l])->weight.copy_(depthwise.index_select(0, previous));
+        }
+        previous = kept;
+    }
+
+    // the flattened features are channel-major, every kept channel keeps its side x side columns
+    auto hiddenFrom = net->ptr<nn::LinearImpl>(from.hidden);
+    auto hiddenTo = pruned->ptr<nn::LinearImpl>(to.hidden);
+    int64_t nHidden = hiddenFrom->weight.size(0);
+    int64_t nFinal = from.finalSide * from.finalSide;
+    Tensor columns = hiddenFrom->weight.view({nHidden, -1, nFinal}).index_select(1, previous);
+    hiddenTo->weight.copy_(columns.reshape({nHidden, -1}));
+    hiddenTo->bias.copy_(hiddenFrom->bias);
+
+    auto outputFrom = net->ptr<nn::LinearImpl>(from.output);
+    auto outputTo = pruned->ptr<nn::LinearImpl>(to.output);
+    outputTo->weight.copy_(outputFrom->weight);
+    outputTo->bias.copy_(outputFrom->bias);
+    return pruned;
+}
+
+vector<DigitNetConfig> DigitNet::presets(){
+    vector<DigitNetConfig> configs;
+    configs.emplace_back();
+
+    // the baseline with half of the channels of every layer pruned away
+    DigitNetConfig pruned;
+    pruned.name = "pruned";
+    pruned.pruneRatio = 0.5f;
+    configs.push_back(pruned);
+
+    DigitNetConfig small;
+    small.name = "small";
+    small.channels = {32, 64};
+    small.hidden = 128;
+    configs.push_back(small);
+
+    DigitNetConfig separable;
+    separable.name = "separable";
+    separable.channels = {32, 64};
+    separable.separable = true;
+    separable.hidden = 64;
+    configs.push_back(separable);
+
+    // printed digits are still legible at 20x20
+    DigitNetConfig tiny;
+    tiny.name = "tiny";
+    tiny.inputSize = 20;
+    tiny.channels = {16, 32};
+    tiny.kernels = {3, 3};
+    tiny.separable = true;
+    tiny.hidden = 64;
+    tiny.dropout = 0.25f;
+    configs.push_back(tiny);
+    return configs;
+}
+
+DigitNetConfig DigitNet::preset(const string& name){
+    for(const DigitNetConfig& config: presets()){
+        if(config.name == name) return config;
+    }
+    cerr << "Unknown digit-net " << name << endl;
+    throw exception();
+}
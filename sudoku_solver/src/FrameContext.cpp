@@ -0,0 +1,32 @@
+#include "FrameContext.hpp"
+#include "AllocationCounter.hpp"
+#include "Trace.hpp"
+
+using namespace std;
+using namespace cv;
+
+FrameContext::FrameContext(const ImgProcParams& params): processor(params){
+    AllocationCounter::countMatAllocations();
+    // enough for every cell, so that pushing the digits never grows it
+    digits.reserve(CellReader::nCells);
+}
+
+bool FrameContext::process(const Mat& img, const Deadline* deadline){
+    TRACE_SCOPE("FrameContext::process");
+    size_t heapBefore = AllocationCounter::heapAllocations();
+    size_t matsBefore = AllocationCounter::matAllocations();
+
+    bool found = true;
+    try{
+        processor.run(img, deadline);
+        CellReader::clean(processor, cells, cleaners, deadline);
+        CellReader::digitImages(processor, cells, digitGrid, digits);
+    } catch(exception&){
+        digits.clear();
+        found = false;
+    }
+
+    lastAllocations.heap = AllocationCounter::heapAllocations() - heapBefore;
+    lastAllocations.mats = AllocationCounter::matAllocations() - matsBefore;
+    return found;
+}
@@ -1,4 +1,5 @@
 #include "ImgProc.hpp"
+#include "Trace.hpp"
 
 using namespace std;
 using namespace cv;
@@ -104,6 +105,10 @@ bool ImgProc::isHorizontalOrVertical(const Vec2f& line, double degThreshold){
     return isHorizontal(line, degThreshold) || isVertical(line, degThreshold);
 }
 
+Rect ImgProc::cellRect(int row, int col, int cellSize){
+    return Rect(col * cellSize, row * cellSize, cellSize, cellSize);
+}
+
 void drawLines(const Mat& cdst, const vector<Vec2f>& lines){
     // Draw the lines
     for(const auto & i : lines){
@@ -122,77 +127,86 @@ void drawLines(const Mat& cdst, const vector<Vec2f>& lines){
     }
 }
 
+// points ImgProc::deadline at the deadline of one run and clears it however the run ends, the
+// deadline usually lives on the stack of the caller
+struct DeadlineScope{
+    const Deadline*& slot;
+
+    DeadlineScope(const Deadline*& slot, const Deadline* deadline): slot(slot) {slot = deadline;};
+    ~DeadlineScope() {slot = nullptr;};
+};
+
 // Main functions
-ImgProc::ImgProc(const Mat& img){
-    origImg = img.clone();
-    sudokuCells = vector<vector<cv::Rect> >(9, vector<cv::Rect>(9));
+ImgProc::ImgProc(const ImgProcParams& params)
+    : params(params), hough(1, CV_PI/180, params.houghAngleWindow){
+}
+
+ImgProc::ImgProc(const Mat& img, const ImgProcParams& params): ImgProc(params){
+    origImg = img;
 }
 
 void ImgProc::calcHoughIntersections(){
-    vector<Vec2f*> horizontal;
-    vector<Vec2f*> vertical;
+    horizontalLines.clear();
+    verticalLines.clear();
     for(auto& line: houghLines){
-        if(isHorizontal(line)) horizontal.push_back(&line);
-        if(isVertical(line)) vertical.push_back(&line);
+        if(isHorizontal(line, params.houghAngleWindow)) horizontalLines.push_back(line);
+        if(isVertical(line, params.houghAngleWindow)) verticalLines.push_back(line);
     }
 
     houghIntersections.clear();
-    for(auto& hor: horizontal){
-        for(auto& ver: vertical){
-            houghIntersections.push_back(lineIntersection(*hor, *ver));
+    for(auto& hor: horizontalLines){
+        for(auto& ver: verticalLines){
+            houghIntersections.push_back(lineIntersection(hor, ver));
         }
     }
 }
 
-Mat ImgProc::houghExtraction(Mat& img){
-    Mat houghImg = Mat::zeros(img.size(), img.type());
+void ImgProc::houghExtraction(const Mat& img, float gridFraction){
+    TRACE_SCOPE("houghExtraction");
+    houghMask.create(img.size(), img.type());
+    houghMask.setTo(0);
 
     int smallerSize = min(img.size().height, img.size().width);
-    int houghThreshold = (float)smallerSize * 0.75;
-
-    HoughLines(img, houghLines, 1, CV_PI/180, houghThreshold, 0, 0 );
-    // drop all diagonal lines
-    for(auto it = houghLines.begin(); it != houghLines.end();){
-        if(!isHorizontalOrVertical(*it)){
-            it = houghLines.erase(it);
-        } else{
-            ++it;
-        }
-    }
+    // a line needs three quarters of the length of the grid, a single grid fills most of the image
+    int houghThreshold = (float)smallerSize * gridFraction * 0.75;
+
+    // votes only for (almost) horizontal and vertical lines, diagonal ones are never needed
+    hough.detect(img, houghLines, houghThreshold);
     calcHoughIntersections();
 
-    drawLines(houghImg, houghLines);
-    imshow("HoughLines", houghImg);
+    // the lines are not only for debugging, they are the mask for the contour search
+    drawLines(houghMask, houghLines);
+    if(params.debugSink) params.debugSink->submit("HoughLines", houghMask);
 
-    Mat invAndHough;
-    img.copyTo(invAndHough, houghImg);
-    return invAndHough;
+    // copyTo leaves the pixels outside of the mask untouched, they still hold the previous frame
+    processedImg.create(img.size(), img.type());
+    processedImg.setTo(0);
+    img.copyTo(processedImg, houghMask);
 }
 
 
-void ImgProc::processImg(){
-    Mat inv = invertImg(this->origImg);
-    imshow("inverted img", inv);
-
-    Mat houghImg = houghExtraction(inv);
-    imshow("houghImg", houghImg);
-
-    waitKey(0);
+void ImgProc::processImg(float gridFraction){
+    TRACE_SCOPE("processImg");
+    bitwise_not(this->detectionImg, invertedImg);
+    houghExtraction(invertedImg, gridFraction);
 
-    processedImg = houghImg;
-}
-
-Rect ImgProc::locateSudokuROI(const vector<vector<Point>> &contours){
-    vector<Rect> rects(contours.size());
-    for(std::size_t i=0; i<contours.size(); i++){
-        rects[i] = boundingRect(contours[i]);
+    if(params.debugSink){
+        params.debugSink->submit("inverted_img", invertedImg);
+        params.debugSink->submit("houghImg", processedImg);
     }
+}
 
+Rect ImgProc::locateSudokuROI(const vector<Rect>& rects){
+    TRACE_SCOPE("locateSudokuROI");
     int minHits = 10;
     int nHits = 0;
-    vector<pair<int, Rect> > result;
+    vector<pair<int, Rect> >& result = roiCandidates;
+    result.clear();
     for(auto& rect : rects){
         if(isSquare(rect)) {
+            // every square is checked against all intersections, images with a lot of texture
+            // have thousands of both
+            checkDeadline();
             nHits = 0;
             for(auto& dot: houghIntersections){
                 nHits += pointInRect(dot, rect);
@@ -203,11 +217,7 @@ Rect ImgProc::locateSudokuROI(const vector<vector<Point>> &contours){
         }
     }
     if(result.empty()){
-        cout << "No Sudoku square found!" << endl;
-        cout << "rects: " << endl;
-        for(auto & rect : rects){
-            cout << "    rect: " << rect << endl;
-        }
+        cerr << "No Sudoku square found among " << rects.size() << " contours" << endl;
         throw exception();
     }
 
@@ -219,10 +229,55 @@ Rect ImgProc::locateSudokuROI(const vector<vector<Point>> &contours){
     return result[0].second;
 }
 
-void ImgProc::locateSudokuCells(){
+void ImgProc::locateSudokuROIs(const vector<Rect>& rects, vector<Rect>& rois){
+    TRACE_SCOPE("locateSudokuROIs");
+    // 10 horizontal times 10 vertical lines, k-means needs one point per grid intersection
+    const int minHits = 100;
+    vector<pair<int, Rect> >& candidates = roiCandidates;
+    candidates.clear();
+    for(auto& rect : rects){
+        if(!isSquare(rect)) continue;
+        checkDeadline();
+        int nHits = 0;
+        for(auto& dot: houghIntersections){
+            nHits += pointInRect(dot, rect);
+        }
+        if(nHits >= minHits) candidates.emplace_back(nHits, rect);
+    }
+
+    /**
+     * Smallest first: a grid comes before the rects that contain it (its outer border, a frame
+     * around several grids, the page), which overlap it and are dropped. The boxes and cells
+     * within a grid do not have enough intersections to be candidates.
+     */
+    sort(candidates.begin(), candidates.end(), [](const pair<int, Rect>& left, const pair<int, Rect>& right) {
+        return left.second.area() < right.second.area();
+    });
+    rois.clear();
+    for(auto& candidate: candidates){
+        if((int)rois.size() >= params.maxGrids) break;
+        bool overlaps = false;
+        for(auto& roi: rois) overlaps = overlaps || (roi & candidate.second).area() > 0;
+        if(!overlaps) rois.push_back(candidate.second);
+    }
+
+    // reading order: a row of grids starts above the middle of its topmost grid, left to right within it
+    sort(rois.begin(), rois.end(), [](const Rect& left, const Rect& right) {return left.y < right.y;});
+    for(size_t start=0; start<rois.size();){
+        size_t end = start + 1;
+        int rowMiddle = rois[start].y + rois[start].height / 2;
+        while(end < rois.size() && rois[end].y < rowMiddle) end++;
+        sort(rois.begin() + start, rois.begin() + end, [](const Rect& left, const Rect& right) {return left.x < right.x;});
+        start = end;
+    }
+}
+
+void ImgProc::locateSudokuCells(Grid& grid){
+    TRACE_SCOPE("locateSudokuCells");
     /**
-     * The function takes sudokuROI and splits it into 9x9 grid
+     * The function takes the ROI of the grid and splits it into 9x9 grid
      */
+    const Rect& sudokuROI = grid.roi;
     int cellHeight = (int)(sudokuROI.height / 9.0);
     int cellWidth = (int)(sudokuROI.width / 9.0);
     int x, y;
@@ -233,22 +288,141 @@ void ImgProc::locateSudokuCells(){
 
             Rect cell = Rect(x, y, cellWidth, cellHeight);
             Rect expanded = ImgProc::expand(cell, 0.2);
-            vector<Point2i> intersectionsInCell;
+            intersectionsInCell.clear();
             for(auto& dot: kmeansIntersections){
                 if(pointInRect(dot, expanded)){
                     intersectionsInCell.push_back(dot);
                 }
             }
-            sudokuCells[row][col] = maxRect(intersectionsInCell);
+            grid.cells[row][col] = maxRect(intersectionsInCell);
+        }
+    }
+}
+
+void ImgProc::rectifyGrid(Grid& grid){
+    TRACE_SCOPE("rectifyGrid");
+    /**
+     * Maps the quadrilateral spanned by the outermost grid intersections to a square of 9x9
+     * cells with a single warp, so that every cell ends up at a fixed position and size.
+     */
+    Point2f corners[4];
+    corners[0] = corners[1] = corners[2] = corners[3] = grid.intersections[0];
+    for(auto& p: grid.intersections){
+        // top-left has the smallest x+y, bottom-right the largest, same for x-y and the other two
+        if(p.x + p.y < corners[0].x + corners[0].y) corners[0] = p;
+        if(p.x - p.y > corners[1].x - corners[1].y) corners[1] = p;
+        if(p.x + p.y > corners[2].x + corners[2].y) corners[2] = p;
+        if(p.x - p.y < corners[3].x - corners[3].y) corners[3] = p;
+    }
+
+    int side = 9 * params.cellSize;
+    Point2f target[4] = {Point2f(0, 0), Point2f((float)side, 0), Point2f((float)side, (float)side), Point2f(0, (float)side)};
+    perspective = getPerspectiveTransform(corners, target);
+    // one warp for the whole grid, into the buffer of the previous frame
+    warpPerspective(origImg, grid.rectified, perspective, Size(side, side), INTER_LINEAR, BORDER_REPLICATE);
+}
+
+void ImgProc::binarizeCells(Grid& grid){
+    TRACE_SCOPE("binarizeCells");
+    // the whole grid is inverted at once, only the threshold itself is local to each cell
+    bitwise_not(grid.rectified, invertedGrid);
+    grid.binary.create(invertedGrid.size(), CV_8UC1);
+    for(int row=0; row<9; row++){
+        for(int col=0; col<9; col++){
+            Rect cell = cellRect(row, col, params.cellSize);
+            Mat inverted = invertedGrid(cell);
+            Mat binary = grid.binary(cell);
+            threshold(inverted, binary, mean(inverted)[0], 255, THRESH_BINARY);
         }
     }
 }
 
+void ImgProc::buildDetectionImg(){
+    TRACE_SCOPE("buildDetectionImg");
+    /**
+     * Large images are detected on a coarse pyramid level, so that inversion, Hough transform
+     * and contours cost roughly the same for any input resolution.
+     */
+    detectionImg = origImg;
+    detectionScale = 1;
+    if(params.detectionMaxSide <= 0) return;
+    size_t level = 0;
+    while(max(detectionImg.rows, detectionImg.cols) > params.detectionMaxSide){
+        if(pyramid.size() <= level) pyramid.emplace_back();
+        pyrDown(detectionImg, pyramid[level]);
+        detectionImg = pyramid[level];
+        detectionScale *= 2;
+        level++;
+    }
+}
+
+void ImgProc::toFullResolution(const Rect& detectionROI, const vector<Point2f>& centers, Grid& grid){
+    TRACE_SCOPE("toFullResolution");
+    float scale = detectionScale;
+    grid.roi = Rect(cvRound(detectionROI.x * scale), cvRound(detectionROI.y * scale),
+                    cvRound(detectionROI.width * scale), cvRound(detectionROI.height * scale));
+
+    grid.intersections.clear();
+    for(auto& c: centers){
+        grid.intersections.push_back(c * scale);
+    }
+    if(detectionScale > 1){
+        // refine on the full resolution image, only small windows around each intersection are read
+        int window = max(3, cvRound(2 * scale));
+        TermCriteria criteria(TermCriteria::COUNT + TermCriteria::EPS, 20, 0.05);
+        cornerSubPix(origImg, grid.intersections, Size(window, window), Size(-1, -1), criteria);
+    }
+
+    kmeansIntersections.clear();
+    for(auto& p: grid.intersections){
+        kmeansIntersections.emplace_back((int) p.x, (int) p.y);
+    }
+}
+
+void ImgProc::findContours(){
+    {
+        TRACE_SCOPE("findContours");
+        // RETR_TREE gives the whole hierarchy of contours, the vectors keep their capacity between frames
+        cv::findContours(processedImg, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);
+    }
+    contourRects.resize(contours.size());
+    for(size_t i=0; i<contours.size(); i++) contourRects[i] = boundingRect(contours[i]);
+    checkDeadline();
+}
+
 void ImgProc::findSudokuGrid(){
-    vector<vector<Point> > contours;
-    vector<Vec4i> hierarchy;
-    // RETR_TREE gives the whole hierarchy of contours
-    findContours(processedImg, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE);
+    findContours();
+
+    // find main Sudoku ROI that holds the whole puzzle
+    Rect detectionROI = locateSudokuROI(contourRects);
+    extractGrid(detectionROI, grids[0], "");
+    nGrids = 1;
+}
+
+void ImgProc::extractGrid(const Rect& detectionROI, Grid& grid, const string& debugName){
+    // run K-means of all intersections within sudoku puzzle to get 1 point per intersection
+    sudokuIntersections.clear();
+    for(auto& inter: houghIntersections){
+        if(pointInRect(inter, detectionROI))
+            sudokuIntersections.push_back(inter);
+    }
+    {
+        TRACE_SCOPE("kmeans");
+        TermCriteria criteria(TermCriteria::MAX_ITER, 20, 0);
+        kmeans(sudokuIntersections, 100, kmeansLabels, criteria, 1, KMEANS_PP_CENTERS, clusterCenters);
+    }
+    checkDeadline();
+
+    // everything from here on happens at full resolution
+    toFullResolution(detectionROI, clusterCenters, grid);
+
+    // locate each Sudoku cell based on where it should be and where the intersections are
+    locateSudokuCells(grid);
+
+    // warp the grid to a square image where all cells have the same size
+    rectifyGrid(grid);
+
+    if(!params.debugSink) return;
 
     Mat origColored;
     cvtColor(origImg, origColored, COLOR_GRAY2RGB);
@@ -260,58 +434,78 @@ void ImgProc::findSudokuGrid(){
 //        }
 //    }
 
-    // find main Sudoku ROI that holds the whole puzzle
-    this->sudokuROI = locateSudokuROI(contours);
-
-    // run K-means of all intersections within sudoku puzzle to get 1 point per intersection
-    vector<Point2f> sudokuIntersections;
-    for(auto& inter: houghIntersections){
-        if(pointInRect(inter, this->sudokuROI))
-            sudokuIntersections.push_back(inter);
-    }
-    Mat bestLabels;//, centers;
-    vector<Point2f> centers;
-    TermCriteria criteria;
-    criteria.type = TermCriteria::Type::MAX_ITER;
-    criteria.maxCount = 20;
-    kmeans(sudokuIntersections, 100, bestLabels, criteria, 1, KMEANS_PP_CENTERS, centers);
-    for(auto& c: centers){
-        kmeansIntersections.emplace_back((int) c.x, (int) c.y);
-    }
-        
     // B G R
     cv::Scalar colorOfBigSquare(255, 0, 0);
-    rectangle(origColored, this->sudokuROI, colorOfBigSquare, 2);
-    imshow("Sudoku Puzzle ROI", origColored);
+    rectangle(origColored, grid.roi, colorOfBigSquare, 2);
 
     for(Point2i& dot: kmeansIntersections){
         cv::Scalar color(0, 0, 255);
         circle(origColored, dot, 1, color, 2);
     }
-    cv::namedWindow("intersections", cv::WINDOW_NORMAL | cv::WINDOW_KEEPRATIO | cv::WINDOW_GUI_EXPANDED);
-    imshow("intersections", origColored);
-
-    // locate each Sudoku cell based on where it should be and where the intersections are
-    locateSudokuCells();
 
     cv::Scalar colorOfCell(0, 255, 0);
     for(int i=0; i<9; i++){
         for(int j=0; j<9; j++){
-            rectangle(origColored, sudokuCells[i][j], colorOfCell, 1);
+            rectangle(origColored, grid.cells[i][j], colorOfCell, 1);
         }
     }
-    imshow("Sudoku cells", origColored);
+    params.debugSink->submit("Sudoku_cells" + debugName, origColored);
+    params.debugSink->submit("Rectified_Sudoku" + debugName, grid.rectified);
+}
 
-    waitKey(0);
+void ImgProc::checkDeadline() const{
+    if(deadline && deadline->expired()) throw DeadlineExceeded(deadline->stopReason());
+}
 
-    destroyAllWindows();
+void ImgProc::run(const Mat& img, const Deadline* deadline){
+    origImg = img;
+    run(deadline);
 }
 
-void ImgProc::run(){
-    processImg();
+void ImgProc::run(const Deadline* deadline){
+    TRACE_SCOPE("ImgProc::run");
+    /**
+     * The stages themselves are OpenCV calls that cannot be interrupted, the deadline is checked
+     * between them and in the loops of the grid search. There is no partial result without a grid.
+     */
+    DeadlineScope scope(this->deadline, deadline);
+    nGrids = 0;
+    checkDeadline();
+    buildDetectionImg();
+    processImg(1);
+    checkDeadline();
     findSudokuGrid();
+    checkDeadline();
+    binarizeCells(grids[0]);
+}
+
+int ImgProc::runAll(const Mat& img, const Deadline* deadline){
+    origImg = img;
+    return runAll(deadline);
+}
+
+int ImgProc::runAll(const Deadline* deadline){
+    TRACE_SCOPE("ImgProc::runAll");
+    DeadlineScope scope(this->deadline, deadline);
+    nGrids = 0;
+    checkDeadline();
+    buildDetectionImg();
+    processImg(params.minGridFraction);
+    checkDeadline();
+    findContours();
+
+    locateSudokuROIs(contourRects, detectionROIs);
+    if(grids.size() < detectionROIs.size()) grids.resize(detectionROIs.size());
+    for(size_t g=0; g<detectionROIs.size(); g++){
+        extractGrid(detectionROIs[g], grids[g], "_" + to_string(g));
+        binarizeCells(grids[g]);
+        // the grids done so far stay available if the deadline stops the others
+        nGrids++;
+        checkDeadline();
+    }
+    return nGrids;
 }
 
-vector<vector<cv::Rect> > ImgProc::getSudokuCells() const{
-    return sudokuCells;
+Mat ImgProc::getBinaryCell(int row, int col, int grid) const{
+    return grids[grid].binary(cellRect(row, col, params.cellSize));
 }
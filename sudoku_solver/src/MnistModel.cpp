@@ -1,56 +1,54 @@
 #include "MnistModel.hpp"
+#include "Trace.hpp"
 
 using namespace std;
 using namespace torch;
 
 
-MnistModel::MnistModel() {
+// helpers
+static Tensor resizeBatch(const Tensor& images, int side){
+    if(images.size(2) == side) return images;
+    namespace F = nn::functional;
+    // averaging, like the cv::INTER_AREA the cells are downsampled with
+    return F::interpolate(images, F::InterpolateFuncOptions().size(vector<int64_t>{side, side}).mode(kArea));
+}
+
+// members
+MnistModel::MnistModel(): MnistModel(DigitNetConfig()) {}
+
+MnistModel::MnistModel(const DigitNetConfig& config, const string& modelPath)
+    : config(config), modelPath(modelPath.empty() ? config.defaultModelPath() : modelPath) {
     if (torch::cuda::is_available()) {
-        cout << "CUDA is available! Training on GPU." << endl;
+        cerr << "CUDA is available! Training on GPU." << endl;
         device = Device(c10::DeviceType::CUDA);
     }
-    net = getModel();
+    net = DigitNet::build(config);
+    net->to(device);
     readyForInference = false;
 }
 
-nn::Sequential MnistModel::getModel(){
-    nn::Sequential discriminator(
-        // input is 28x28
-        nn::Conv2d(
-            nn::Conv2dOptions(1, 64, 5).stride(1).padding(0).bias(false)
-        ),
-        nn::LeakyReLU(nn::LeakyReLUOptions().negative_slope(0.2)),
-        nn::MaxPool2d(nn::MaxPool2dOptions({2, 2}).stride({2, 2})),
-        // Layer 2
-        nn::Conv2d(
-            nn::Conv2dOptions(64, 128, 3).stride(1).padding(0).bias(false)
-        ),
-        // nn::BatchNorm2d(128),
-        nn::LeakyReLU(nn::LeakyReLUOptions().negative_slope(0.2)),
-        nn::MaxPool2d(nn::MaxPool2dOptions({2, 2}).stride({2, 2})),  // output is 5x5
-        // Layer 3
-        nn::Flatten(),
-        nn::Dropout(nn::DropoutOptions().p(0.5)),
-        nn::Linear(25 * 128, 256),
-        nn::LeakyReLU(nn::LeakyReLUOptions().negative_slope(0.2)),
-        nn::Linear(256, MnistModel::nClasses),
-        nn::LogSoftmax(nn::LogSoftmaxOptions(1))
-    );  
-    discriminator->to(device);
-
-    return discriminator;
-}
-
 template <typename DataLoader>
 void MnistModel::trainEpoch(int epoch, nn::Sequential& model, DataLoader& data_loader, optim::Optimizer& optimizer,
-    size_t dataset_size){
+    size_t dataset_size, const TrainOptions& options){
     model->train();
     size_t batch_idx = 0;
     for (auto& batch : data_loader) {
         auto data = batch.data.to(device), targets = batch.target.to(device);
         optimizer.zero_grad();
-        Tensor output = model->forward(data);
+        Tensor output = model->forward(resizeBatch(data, config.inputSize));
         Tensor loss = torch::nll_loss(output, targets);
+        if (options.teacher) {
+            /**
+             * Soft targets: dividing log-probabilities by the temperature is the same as dividing
+             * the logits, the constant per image cancels in the softmax. The divergence is scaled
+             * by T^2 so that its gradients keep their size whatever the temperature.
+             */
+            float t = options.temperature;
+            Tensor soft = torch::softmax(options.teacher->logProbabilities(data) / t, 1);
+            Tensor distillation = torch::kl_div(torch::log_softmax(output / t, 1), soft, Reduction::Sum)
+                * (t * t / data.size(0));
+            loss = loss * (1 - options.distillWeight) + distillation * options.distillWeight;
+        }
         AT_ASSERT(!std::isnan(loss.template item<float>()));
         loss.backward();
         optimizer.step();
@@ -68,14 +66,14 @@ void MnistModel::trainEpoch(int epoch, nn::Sequential& model, DataLoader& data_l
 }
 
 template <typename DataLoader>
-void MnistModel::test(nn::Sequential& model, DataLoader& data_loader, size_t dataset_size) {
+double MnistModel::test(nn::Sequential& model, DataLoader& data_loader, size_t dataset_size) {
     NoGradGuard no_grad;
     model->eval();
     double test_loss = 0;
     int32_t correct = 0;
     for (const auto& batch : data_loader) {
         auto data = batch.data.to(device), targets = batch.target.to(device);
-        Tensor output = model->forward(data);
+        Tensor output = model->forward(resizeBatch(data, config.inputSize));
         test_loss += nll_loss(
             output,
             targets,
@@ -91,13 +89,22 @@ void MnistModel::test(nn::Sequential& model, DataLoader& data_loader, size_t dat
         "\nTest set: Average loss: %.4f | Accuracy: %.3f\n",
         test_loss,
         static_cast<double>(correct) / dataset_size);
+    return static_cast<double>(correct) / dataset_size;
 }
 
 
-void MnistModel::trainModel(){
+void MnistModel::trainModel(const TrainOptions& options){
+    /**
+     * With a pruneRatio the unpruned architecture is trained first, then the least important
+     * channels are removed and the smaller net is fine-tuned. A teacher (usually the baseline)
+     * only provides soft targets, it is never trained.
+     */
+    if (options.teacher == this) {
+        cerr << "A model cannot be distilled from itself" << endl;
+        throw exception();
+    }
     float learning_rate = 1e-3;
     float l2_loss = 1e-5;
-    optim::Adam optimizer(net->parameters(), optim::AdamOptions(learning_rate).weight_decay(l2_loss));
 
     auto train_dataset = data::datasets::MNIST(dataPath)
                             .map(data::transforms::Normalize<>(dataMean, dataStd))
@@ -113,15 +120,50 @@ void MnistModel::trainModel(){
     auto test_loader =
         torch::data::make_data_loader(std::move(test_dataset), testBatchSize);
 
-    for (int epoch = 1; epoch <= numberOfEpochs; ++epoch) {
-        cout << "Epoch: " << epoch << endl;
-        trainEpoch(epoch, net, *train_loader, optimizer, train_dataset_size);
-        test(net, *test_loader, test_dataset_size);
+    auto fit = [&](nn::Sequential& model, int epochs, float rate) {
+        optim::Adam optimizer(model->parameters(), optim::AdamOptions(rate).weight_decay(l2_loss));
+        for (int epoch = 1; epoch <= epochs; ++epoch) {
+            cerr << "Epoch: " << epoch << endl;
+            trainEpoch(epoch, model, *train_loader, optimizer, train_dataset_size, options);
+            test(model, *test_loader, test_dataset_size);
+        }
+    };
+
+    nn::Sequential model = DigitNet::build(config.unpruned());
+    model->to(device);
+    fit(model, options.epochs, learning_rate);
+    if (config.pruneRatio > 0) {
+        model = DigitNet::prune(model, config);
+        model->to(device);
+        cerr << "Pruned to " << DigitNet::cost(config).params << " parameters, fine-tuning" << endl;
+        test(model, *test_loader, test_dataset_size);
+        fit(model, options.fineTuneEpochs, learning_rate / 10);
     }
 
-    readyForInference = true;
+    {
+        lock_guard<mutex> lock(inferenceMutex);
+        net = model;
+        readyForInference = true;
+    }
     save(net, modelPath);
-    cout << "Saved the model at " << modelPath << endl;
+    cerr << "Saved the model at " << modelPath << endl;
+}
+
+double MnistModel::testAccuracy(){
+    prepareInference();
+    auto test_dataset = data::datasets::MNIST(dataPath, data::datasets::MNIST::Mode::kTest)
+                            .map(data::transforms::Normalize<>(dataMean, dataStd))
+                            .map(data::transforms::Stack<>());
+    const size_t test_dataset_size = test_dataset.size().value();
+    auto test_loader =
+        torch::data::make_data_loader(std::move(test_dataset), testBatchSize);
+    return test(net, *test_loader, test_dataset_size);
+}
+
+Tensor MnistModel::logProbabilities(const Tensor& images){
+    prepareInference();
+    NoGradGuard no_grad;
+    return net->forward(resizeBatch(images.to(device), config.inputSize));
 }
 
 cv::Mat MnistModel::convertImg(Tensor input){
@@ -139,7 +181,7 @@ cv::Mat MnistModel::convertImg(Tensor input){
 
 Tensor MnistModel::convertImg(const cv::Mat& input){
     if(input.channels() != 1){
-        cout << "image has more than 1 channels: " << input.channels() << endl;
+        cerr << "image has more than 1 channels: " << input.channels() << endl;
         throw exception();
     }
     // cv::Mat imgFloat;
@@ -155,30 +197,19 @@ Tensor MnistModel::convertImg(const cv::Mat& input){
 }
 
 
-vector<pair<int, float> > MnistModel::inferClass(const cv::Mat& digit){
+void MnistModel::prepareInference(){
+    // several threads might want to infer at the same time, the model is loaded only once
+    lock_guard<mutex> lock(inferenceMutex);
     if(!readyForInference){
-        cout << "Loading the saved model from " << modelPath << " ...";
+        cerr << "Loading the saved model from " << modelPath << " ...";
         load(net, modelPath);
-        cout << " done." << endl;
+        cerr << " done." << endl;
         readyForInference = true;
     }
     net->eval();
+}
 
-    // reshape
-    cv::Mat resized;
-    cv::resize(digit, resized, cv::Size(28, 28));
-
-    cv::Mat floatImg;
-    resized.convertTo(floatImg, CV_32FC1); 
-    floatImg = floatImg / 255.0;
- 
-    // normalize
-    floatImg = (floatImg - dataMean) / dataStd;
-
-    Tensor netInput = convertImg(floatImg).to(device);;
-    Tensor output = torch::exp(net->forward(netInput)).to(kCPU);
-    auto* probs = output.data_ptr<float>();
-
+vector<pair<int, float> > MnistModel::topClasses(const float* probs) const{
     // get top 3 most likely digits
     auto cmp = [](pair<int, float> left, pair<int, float> right) { return left.second < right.second; };
     priority_queue<pair<int, float>, vector<pair<int, float> >, decltype(cmp)> classWithProb(cmp);
@@ -195,7 +226,42 @@ vector<pair<int, float> > MnistModel::inferClass(const cv::Mat& digit){
     vector<pair<int, float> > res = {top_class, snd_class, trd_class}; 
 
     return res;
-} 
+}
+
+vector<pair<int, float> > MnistModel::inferClass(const cv::Mat& digit){
+    return inferClasses(vector<cv::Mat>{digit})[0];
+}
+
+vector<vector<pair<int, float> > > MnistModel::inferClasses(const vector<cv::Mat>& digits){
+    TRACE_SCOPE("inferClass");
+    prepareInference();
+    NoGradGuard no_grad;
+
+    const int nDigits = (int)digits.size();
+    const int side = config.inputSize;
+    Tensor netInput = torch::empty({nDigits, 1, side, side});
+    float* inputData = netInput.data_ptr<float>();
+    for(int d=0; d<nDigits; d++){
+        // reshape, unless the digit already has the input size
+        cv::Mat resized = digits[d];
+        if(resized.size() != cv::Size(side, side)){
+            cv::resize(digits[d], resized, cv::Size(side, side), 0, 0, cv::INTER_AREA);
+        }
+
+        // scale to [0, 1] and normalize, written straight into the batch
+        cv::Mat floatImg(side, side, CV_32FC1, inputData + d * side * side);
+        resized.convertTo(floatImg, CV_32FC1, 1.0 / (255.0 * dataStd), -dataMean / dataStd);
+    }
+
+    Tensor output = torch::exp(net->forward(netInput.to(device))).to(kCPU);
+    const float* probs = output.data_ptr<float>();
+
+    vector<vector<pair<int, float> > > res(nDigits);
+    for(int d=0; d<nDigits; d++){
+        res[d] = topClasses(probs + d * nClasses);
+    }
+    return res;
+}
 
 
 void MnistModel::testLibTorch(){
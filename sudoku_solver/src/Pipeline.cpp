@@ -0,0 +1,193 @@
+#include "Pipeline.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+using namespace std;
+using namespace cv;
+
+// helpers
+static void drawDigits(Mat& drawing, const vector<vector<Rect> >& cells, const Sudoku& digits){
+    Scalar blue(255, 0, 0);
+    Scalar red(0, 0, 255);
+    Scalar green(0, 255, 0);
+
+    for (int row=0; row<Sudoku::N; row++) { 
+        for (int col=0; col<Sudoku::N; col++){
+            Point2i org(cells[row][col].x + cells[row][col].width * 0.2, cells[row][col].y + cells[row][col].height / 2.0);
+            string digitText = to_string(digits.getValue(row, col));
+            Scalar color;
+            if(digits.getProb(row, col) == UNASSIGNED){
+                color = blue;
+            } else if(digits.getProb(row, col) > MnistModel::acceptanceThreshold){
+                color = green;
+            } else{
+                color = red;
+            }
+            putText(drawing, digitText, org, FONT_HERSHEY_PLAIN, 1, color, 2);
+        }
+    }
+}
+
+// members
+vector<Sudoku> solveCandidates(vector<Sudoku>& games, int nThreads, Sudoku::Backend backend, const Deadline* deadline){
+    TRACE_SCOPE("solveCandidates");
+    #pragma omp parallel for num_threads(nThreads)
+    for(size_t i=0; i<games.size(); i++){
+        games[i].setBackend(backend);
+        games[i].setDeadline(deadline);
+        if(deadline && deadline->expired()) continue;
+        if(games[i].isValid())
+            games[i].solve();
+    }
+
+    vector<Sudoku> solved;
+    for(auto& game: games){
+        if(game.isSolved()) solved.emplace_back(move(game));
+    }
+    sort(solved.begin(), solved.end(), [](const Sudoku& left, const Sudoku& right) {
+        return left.getJoinProbability() > right.getJoinProbability();
+    });
+    return solved;
+}
+
+SolveResult solveImage(const Mat& img, const SolveOptions& options){
+    TRACE_SCOPE("solveImage");
+    SolveResult result;
+    MnistModel& model = options.model ? *options.model : MnistModel::getInstance();
+    Deadline budget(options.budgetMs);
+    const Deadline* deadline = options.deadline ? options.deadline : &budget;
+    // the first stage that notices the deadline is the one that stopped
+    auto stopped = [&](const char* stage){
+        if(!deadline->expired()) return false;
+        if(result.stoppedStage.empty()) result.stoppedStage = stage;
+        result.stopReason = deadline->stopReason();
+        return true;
+    };
+
+    ImgProc processor(img, options.imgProcParams);
+    try{
+        processor.run(deadline);
+    } catch(DeadlineExceeded& e){
+        stopped("grid detection");
+        result.error = string("grid detection stopped: ") + e.what();
+        DeadlineMetrics::record(*deadline);
+        return result;
+    } catch(exception&){
+        result.error = "no sudoku grid found";
+        DeadlineMetrics::record(*deadline);
+        return result;
+    }
+    result.gridFound = true;
+    result.cellRects = processor.getSudokuCells();
+
+    CellReader::read(processor, model, result.cells, deadline);
+    if(!stopped("recognition")){
+        vector<Sudoku> possibleGames = CellReader::candidateGames(result.cells, deadline);
+        result.nCandidates = possibleGames.size();
+        stopped("candidates");
+        result.solutions = solveCandidates(possibleGames, options.solverThreads, options.solverBackend, deadline);
+        // a solution found just before the deadline is not a stop
+        if(result.solutions.empty()) stopped("solve");
+    }
+    DeadlineMetrics::record(*deadline);
+
+    if(options.imgProcParams.debugSink){
+        for(size_t i=0; i<result.solutions.size(); i++){
+            Mat drawing;
+            drawResult(img, drawing, result.cellRects, result.solutions[i]);
+            options.imgProcParams.debugSink->submit("Result_" + to_string(i), drawing);
+        }
+    }
+    return result;
+}
+
+PageResult solveImageGrids(const Mat& img, const SolveOptions& options){
+    TRACE_SCOPE("solveImageGrids");
+    PageResult page;
+    MnistModel& model = options.model ? *options.model : MnistModel::getInstance();
+    Deadline budget(options.budgetMs);
+    const Deadline* deadline = options.deadline ? options.deadline : &budget;
+    auto stopped = [&](const char* stage){
+        if(!deadline->expired()) return false;
+        if(page.stoppedStage.empty()) page.stoppedStage = stage;
+        page.stopReason = deadline->stopReason();
+        return true;
+    };
+
+    ImgProc processor(img, options.imgProcParams);
+    int nGrids = 0;
+    try{
+        nGrids = processor.runAll(deadline);
+    } catch(DeadlineExceeded& e){
+        // the grids extracted before the deadline are returned with their cells, but without digits:
+        // readAll skips the cleaning and the recognition once the deadline expired
+        stopped("grid detection");
+        nGrids = processor.getNumGrids();
+        if(nGrids == 0) page.error = string("grid detection stopped: ") + e.what();
+    } catch(exception&){
+        nGrids = processor.getNumGrids();
+    }
+    if(nGrids == 0){
+        if(page.error.empty()) page.error = "no sudoku grid found";
+        DeadlineMetrics::record(*deadline);
+        return page;
+    }
+
+    vector<CellReader::CellResults> cells;
+    CellReader::readAll(processor, model, cells, deadline);
+    page.grids.resize(nGrids);
+    for(int g=0; g<nGrids; g++){
+        page.grids[g].gridFound = true;
+        page.grids[g].cellRects = processor.getSudokuCells(g);
+        page.grids[g].cells = move(cells[g]);
+    }
+
+    if(!stopped("recognition")){
+        /**
+         * The grids are independent, so they are solved concurrently instead of one after the
+         * other. Nested parallelism is off by default, so the candidates of one grid are then
+         * solved by the thread of that grid.
+         */
+        #pragma omp parallel for schedule(dynamic)
+        for(int g=0; g<nGrids; g++){
+            SolveResult& result = page.grids[g];
+            vector<Sudoku> possibleGames = CellReader::candidateGames(result.cells, deadline);
+            result.nCandidates = possibleGames.size();
+            result.solutions = solveCandidates(possibleGames, options.solverThreads, options.solverBackend, deadline);
+            if(result.solutions.empty() && deadline->expired()){
+                result.stopReason = deadline->stopReason();
+                result.stoppedStage = "solve";
+            }
+        }
+        for(auto& result: page.grids){
+            if(result.isStopped()) stopped("solve");
+        }
+    }
+    for(auto& result: page.grids){
+        if(!result.isStopped() && page.isStopped()){
+            result.stopReason = page.stopReason;
+            result.stoppedStage = page.stoppedStage;
+        }
+    }
+    DeadlineMetrics::record(*deadline);
+
+    if(options.imgProcParams.debugSink){
+        Mat drawing;
+        drawResults(img, drawing, page);
+        options.imgProcParams.debugSink->submit("Result_page", drawing);
+    }
+    return page;
+}
+
+void drawResult(const Mat& img, Mat& drawing, const vector<vector<Rect> >& cells, const Sudoku& digits){
+    cvtColor(img, drawing, COLOR_GRAY2RGB);
+    drawDigits(drawing, cells, digits);
+}
+
+void drawResults(const Mat& img, Mat& drawing, const PageResult& page){
+    cvtColor(img, drawing, COLOR_GRAY2RGB);
+    for(auto& result: page.grids){
+        if(result.isSolved()) drawDigits(drawing, result.cellRects, result.solutions[0]);
+    }
+}
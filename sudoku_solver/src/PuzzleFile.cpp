@@ -0,0 +1,208 @@
+#include "PuzzleFile.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// helpers
+static void fromGame(const Sudoku& game, int values[PuzzleFile::nCells]){
+    for(int cell = 0; cell < PuzzleFile::nCells; cell++){
+        int value = game.getValue(cell / Sudoku::N, cell % Sudoku::N);
+        values[cell] = value > 0 ? value : 0;
+    }
+}
+
+// members
+uint32_t PuzzleFile::recordSize(uint16_t flags){
+    return packedSize + (flags & HAS_SOLUTION ? packedSize : 0) + (flags & HAS_DIFFICULTY ? sizeof(uint32_t) : 0);
+}
+
+bool PuzzleFile::pack(const int values[nCells], uint8_t packed[packedSize]){
+    // a nibble above 9 would only be found when the record is read
+    bool valid = true;
+    for(int i = 0; i < packedSize; i++){
+        int low = values[2 * i];
+        int high = 2 * i + 1 < nCells ? values[2 * i + 1] : 0;
+        valid = valid && low <= 9 && high <= 9;
+        low = low > 0 && low <= 9 ? low : 0;
+        high = high > 0 && high <= 9 ? high : 0;
+        packed[i] = (uint8_t)(low | high << 4);
+    }
+    return valid;
+}
+
+bool PuzzleFile::unpack(const uint8_t packed[packedSize], int values[nCells]){
+    // branch-free, the nibbles 10..15 are only collected and cleared
+    int invalid = 0;
+    for(int i = 0; i < nCells / 2; i++){
+        int low = packed[i] & 0xf;
+        int high = packed[i] >> 4;
+        invalid |= (low > 9) | (high > 9);
+        values[2 * i] = low > 9 ? 0 : low;
+        values[2 * i + 1] = high > 9 ? 0 : high;
+    }
+    int last = packed[packedSize - 1] & 0xf;
+    invalid |= last > 9;
+    values[nCells - 1] = last > 9 ? 0 : last;
+    return !invalid;
+}
+
+bool PuzzleFile::parseText(const string& line, int values[nCells], size_t offset){
+    if(line.size() < offset + nCells) return false;
+    for(int cell = 0; cell < nCells; cell++){
+        char c = line[offset + cell];
+        values[cell] = c >= '1' && c <= '9' ? c - '0' : 0;
+    }
+    return true;
+}
+
+string PuzzleFile::toText(const int values[nCells]){
+    string text(nCells, '.');
+    for(int cell = 0; cell < nCells; cell++)
+        if(values[cell] > 0) text[cell] = (char)('0' + values[cell]);
+    return text;
+}
+
+PuzzleFileReader::PuzzleFileReader(const string& path){
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0){
+        cerr << "Cannot open " << path << ": " << strerror(errno) << endl;
+        if(fd >= 0) ::close(fd);
+        throw exception();
+    }
+    mappedSize = info.st_size;
+    if(mappedSize >= sizeof(PuzzleFile::Header)){
+        void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        data = mapping == MAP_FAILED ? nullptr : (const uint8_t*)mapping;
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+    if(!data){
+        cerr << "Cannot map " << path << endl;
+        throw exception();
+    }
+
+    PuzzleFile::Header header;
+    memcpy(&header, data, sizeof(header));
+    flags = header.flags;
+    stride = header.recordSize;
+    count = header.count;
+    if(header.magic == __builtin_bswap32(PuzzleFile::magic)){
+        cerr << path << " was written on a machine with the other byte order" << endl;
+        munmap((void*)data, mappedSize);
+        throw exception();
+    }
+    bool valid = header.magic == PuzzleFile::magic && header.version == PuzzleFile::version
+        && stride == PuzzleFile::recordSize(flags)
+        && count <= (mappedSize - sizeof(header)) / stride;
+    if(!valid){
+        cerr << path << " is not a puzzle file or is truncated" << endl;
+        munmap((void*)data, mappedSize);
+        throw exception();
+    }
+    // records are usually streamed from the first to the last
+    madvise((void*)data, mappedSize, MADV_SEQUENTIAL);
+}
+
+PuzzleFileReader::~PuzzleFileReader(){
+    munmap((void*)data, mappedSize);
+}
+
+bool PuzzleFileReader::getSolution(size_t index, int values[PuzzleFile::nCells]) const{
+    if(!hasSolutions() || index >= count) return false;
+    const uint8_t* packed = record(index) + PuzzleFile::packedSize;
+    return PuzzleFile::unpack(packed, values) && values[0] != 0;
+}
+
+uint32_t PuzzleFileReader::getDifficulty(size_t index) const{
+    if(!hasDifficulty() || index >= count) return 0;
+    uint32_t difficulty;
+    memcpy(&difficulty, record(index) + stride - sizeof(difficulty), sizeof(difficulty));
+    return difficulty;
+}
+
+bool PuzzleFileReader::read(size_t index, Sudoku& game) const{
+    if(index >= count) return false;
+    int values[PuzzleFile::nCells];
+    bool valid = getGivens(index, values);
+    game.reset(values);
+    return valid;
+}
+
+PuzzleFileWriter::PuzzleFileWriter(const string& path, uint16_t flags)
+    : path(path), file(path, ios::binary | ios::trunc), flags(flags), stride(PuzzleFile::recordSize(flags)){
+    if(!file){
+        cerr << "Cannot write " << path << endl;
+        throw exception();
+    }
+    buffer.reserve(bufferSize);
+    // the header is written again with the count on close()
+    PuzzleFile::Header header = {PuzzleFile::magic, PuzzleFile::version, flags, stride, 0, 0};
+    file.write((const char*)&header, sizeof(header));
+    check();
+}
+
+PuzzleFileWriter::~PuzzleFileWriter(){
+    try{
+        close();
+    } catch(exception&){
+        // printed already, a destructor must not throw
+    }
+}
+
+bool PuzzleFileWriter::write(const int givens[PuzzleFile::nCells], const int* solution, uint32_t difficulty){
+    if(buffer.size() + stride > bufferSize) flush();
+    size_t offset = buffer.size();
+    buffer.resize(offset + stride);
+    uint8_t* record = &buffer[offset];
+    bool valid = PuzzleFile::pack(givens, record);
+    record += PuzzleFile::packedSize;
+    if(flags & PuzzleFile::HAS_SOLUTION){
+        if(solution) valid = PuzzleFile::pack(solution, record) && valid;
+        else memset(record, 0, PuzzleFile::packedSize);
+        record += PuzzleFile::packedSize;
+    }
+    if(flags & PuzzleFile::HAS_DIFFICULTY) memcpy(record, &difficulty, sizeof(difficulty));
+    count++;
+    return valid;
+}
+
+bool PuzzleFileWriter::write(const Sudoku& puzzle, const Sudoku* solution, uint32_t difficulty){
+    int givens[PuzzleFile::nCells], solved[PuzzleFile::nCells];
+    fromGame(puzzle, givens);
+    if(solution) fromGame(*solution, solved);
+    return write(givens, solution ? solved : nullptr, difficulty);
+}
+
+void PuzzleFileWriter::flush(){
+    file.write((const char*)buffer.data(), buffer.size());
+    buffer.clear();
+    check();
+}
+
+void PuzzleFileWriter::check(){
+    if(file.good()) return;
+    cerr << "Cannot write " << path << ", the file is incomplete" << endl;
+    // close() must not try again
+    file.close();
+    throw exception();
+}
+
+void PuzzleFileWriter::close(){
+    if(!file.is_open()) return;
+    flush();
+    PuzzleFile::Header header = {PuzzleFile::magic, PuzzleFile::version, flags, stride, 0, count};
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(header));
+    file.flush();
+    check();
+    // closing flushes what the stream still buffers
+    file.close();
+    check();
+}
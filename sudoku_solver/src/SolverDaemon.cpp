@@ -0,0 +1,241 @@
+#include "SolverDaemon.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+#include "BlockingQueue.hpp"
+
+using namespace std;
+using namespace cv;
+
+// larger requests are considered broken and end the connection
+static const uint32_t maxPayload = 64 << 20;
+
+SolverDaemon::SolverDaemon(const string& socketPath, const SolveOptions& options)
+    : socketPath(socketPath), options(options){
+}
+
+SolverDaemon::~SolverDaemon(){
+    stop();
+}
+
+void SolverDaemon::warmUp(){
+    auto start = chrono::steady_clock::now();
+    if(!options.model) options.model = &MnistModel::getInstance();
+    Mat blank = Mat::zeros(MnistModel::inputSize, MnistModel::inputSize, CV_8UC1);
+    options.model->inferClasses(vector<Mat>{blank});
+    auto end = chrono::steady_clock::now();
+    cerr << "Warm-up (model load and first inference) took "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+}
+
+void SolverDaemon::serve(){
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    unlink(socketPath.c_str());
+    if(listenFd < 0 || bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0){
+        cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+        throw exception();
+    }
+
+    running = true;
+    lastReport = chrono::steady_clock::now().time_since_epoch().count();
+    cerr << "Listening on " << socketPath << endl;
+    while(running){
+        int fd = accept(listenFd, nullptr, nullptr);
+        if(fd < 0){
+            if(!running) break;
+            // out of descriptors or memory (EMFILE, ENFILE, ENOBUFS) persists until connections
+            // close, retrying right away would only spin
+            if(errno != EINTR && errno != ECONNABORTED) this_thread::sleep_for(chrono::milliseconds(10));
+            continue;
+        }
+        lock_guard<mutex> lock(connectionsMutex);
+        // stop() came between accept and here, closeConnections() would not see this one
+        if(!running){
+            close(fd);
+            break;
+        }
+        connections.insert(fd);
+        thread(&SolverDaemon::serveConnection, this, fd).detach();
+    }
+    closeConnections();
+}
+
+void SolverDaemon::stop(){
+    if(!running.exchange(false)) return;
+    // wakes up accept() in serve(), which cleans up
+    shutdown(listenFd, SHUT_RDWR);
+}
+
+void SolverDaemon::closeConnections(){
+    close(listenFd);
+    listenFd = -1;
+    unlink(socketPath.c_str());
+
+    // wake up the connection threads and wait until they are gone
+    unique_lock<mutex> lock(connectionsMutex);
+    for(int fd: connections) shutdown(fd, SHUT_RDWR);
+    connectionsDone.wait(lock, [this]{ return connections.empty(); });
+    cerr << "Served " << nRequests << " requests." << endl;
+    DeadlineMetrics::print(cerr);
+}
+
+void SolverDaemon::serveConnection(int fd){
+    // reading the next requests overlaps with solving the current one
+    BlockingQueue<Request> requests(64);
+    thread reader([this, fd, &requests]{
+        Request request;
+        while(DaemonProtocol::readFully(fd, &request.header, sizeof(request.header))){
+            if(request.header.magic != DaemonProtocol::requestMagic || request.header.length > maxPayload) break;
+            request.payload.resize(request.header.length);
+            if(!DaemonProtocol::readFully(fd, request.payload.data(), request.payload.size())) break;
+            requests.push(move(request));
+            request = Request();
+        }
+        requests.close();
+    });
+
+    Request request;
+    bool connected = true;
+    while(requests.pop(request)){
+        if(!connected) continue;
+        DaemonProtocol::Response response = handle(request);
+        if(!DaemonProtocol::writeFully(fd, &response, sizeof(response))){
+            // the client is gone, make the reader give up as well
+            connected = false;
+            shutdown(fd, SHUT_RD);
+        }
+    }
+    reader.join();
+
+    // erased before it is closed, once closed accept() may hand out the same number again
+    lock_guard<mutex> lock(connectionsMutex);
+    connections.erase(fd);
+    close(fd);
+    connectionsDone.notify_all();
+}
+
+DaemonProtocol::Response SolverDaemon::handle(const Request& request){
+    auto start = chrono::steady_clock::now();
+
+    DaemonProtocol::Response response;
+    memset(&response, 0, sizeof(response));
+    response.header.magic = DaemonProtocol::responseMagic;
+    response.header.id = request.header.id;
+    memset(response.grid, '.', sizeof(response.grid));
+
+    // an exception would end the connection thread and with it the whole daemon
+    try{
+        switch(request.header.type){
+            case DaemonProtocol::IMAGE:
+                solveImageRequest(request, response);
+                break;
+            case DaemonProtocol::PUZZLE:
+                solvePuzzleRequest(request, response);
+                break;
+            default:
+                response.header.status = DaemonProtocol::BAD_REQUEST;
+        }
+    } catch(exception& e){
+        cerr << "Request " << request.header.id << " failed: " << e.what() << endl;
+        memset(response.grid, '.', sizeof(response.grid));
+        memset(response.confidences, 0, sizeof(response.confidences));
+        response.header.status = DaemonProtocol::FAILED;
+    }
+
+    nRequests++;
+    response.header.serviceMicros = (uint32_t)chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+    reportPeriodically();
+    return response;
+}
+
+void SolverDaemon::reportPeriodically(){
+    long long now = chrono::steady_clock::now().time_since_epoch().count();
+    long long last = lastReport.load();
+    long long interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::seconds(reportInterval)).count();
+    // only the connection thread that moves lastReport forward prints
+    if(now - last < interval || !lastReport.compare_exchange_strong(last, now)) return;
+    cerr << "Served " << nRequests << " requests so far." << endl;
+    DeadlineMetrics::print(cerr);
+}
+
+static void fillResponse(const Sudoku& game, DaemonProtocol::Response& response){
+    for(int row=0; row<Sudoku::N; row++){
+        for(int col=0; col<Sudoku::N; col++){
+            int k = row * Sudoku::N + col;
+            int value = game.getValue(row, col);
+            float prob = game.getProb(row, col);
+            response.grid[k] = value == UNASSIGNED ? '.' : (char)('0' + value);
+            response.confidences[k] = prob == UNASSIGNED ? 0.f : prob;
+        }
+    }
+}
+
+void SolverDaemon::solveImageRequest(const Request& request, DaemonProtocol::Response& response){
+    // imdecode asserts on an empty buffer
+    if(request.payload.empty()){
+        response.header.status = DaemonProtocol::BAD_REQUEST;
+        return;
+    }
+    Mat encoded(1, (int)request.payload.size(), CV_8UC1, (void*)request.payload.data());
+    Mat img = imdecode(encoded, IMREAD_GRAYSCALE);
+    if(img.empty()){
+        response.header.status = DaemonProtocol::BAD_REQUEST;
+        return;
+    }
+
+    SolveResult result = solveImage(img, options);
+    if(!result.gridFound){
+        response.header.status = result.isStopped() ? DaemonProtocol::TIMED_OUT : DaemonProtocol::NO_GRID;
+        return;
+    }
+    if(result.isSolved()){
+        response.header.status = DaemonProtocol::SOLVED;
+        fillResponse(result.solutions[0], response);
+        return;
+    }
+    // no solution, but the recognized digits might still be useful
+    response.header.status = result.isStopped() ? DaemonProtocol::TIMED_OUT : DaemonProtocol::UNSOLVABLE;
+    for(auto& cell: result.cells){
+        if(!cell.hasDigit() || cell.candidates.empty()) continue;
+        int k = cell.row * Sudoku::N + cell.col;
+        response.grid[k] = (char)('0' + cell.candidates[0].first);
+        response.confidences[k] = cell.candidates[0].second;
+    }
+}
+
+void SolverDaemon::solvePuzzleRequest(const Request& request, DaemonProtocol::Response& response){
+    if(request.payload.size() != DaemonProtocol::nCells){
+        response.header.status = DaemonProtocol::BAD_REQUEST;
+        return;
+    }
+    Deadline deadline(options.budgetMs);
+    Sudoku game;
+    game.setBackend(options.solverBackend);
+    game.setDeadline(&deadline);
+    for(int k=0; k<DaemonProtocol::nCells; k++){
+        char c = request.payload[k];
+        if(c >= '1' && c <= '9') game.fill(k / Sudoku::N, k % Sudoku::N, c - '0', 1.0);
+    }
+    fillResponse(game, response);
+    bool solved = game.isValid() && game.solve();
+    DeadlineMetrics::record(deadline);
+    if(!solved){
+        response.header.status = game.isStopped() ? DaemonProtocol::TIMED_OUT : DaemonProtocol::UNSOLVABLE;
+        return;
+    }
+    response.header.status = DaemonProtocol::SOLVED;
+    fillResponse(game, response);
+}
@@ -1,36 +1,85 @@
 #include "Sudoku.hpp"
+#include "CdclSolver.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
 
 using namespace std;
 
 // helpers
-inline bool findNextCell(const vector<vector<int> >& grid, int& row, int& col){
-    for (row = 0; row < Sudoku::N; row++) 
-        for (col = 0; col < Sudoku::N; col++) 
-            if (grid[row][col] == UNASSIGNED) 
-                return true; 
-    return false; 
-}
 
-inline bool isValidEntry(const vector<vector<int> >& grid, int row, int col, int value){
-    // check row
-    for(int c=0; c<Sudoku::N; c++)
-        if(c != col && grid[row][c] == value)
-            return false;
+// digits placed so far plus, per unit, the mask and the sum of its digits
+struct SearchState{
+    const SudokuRules& rules;
+    int values[SudokuRules::nCells];
+    vector<int> used;
+    vector<int> usedSum;
+    const Deadline* deadline;
+    bool stopped = false;
 
-    // check column
-    for(int r=0; r<Sudoku::N; r++)
-        if(r != row && grid[r][col] == value)
-            return false;
+    SearchState(const SudokuRules& rules, const vector<vector<int> >& grid, const Deadline* deadline)
+        : rules(rules), used(rules.getNumUnits(), 0), usedSum(rules.getNumUnits(), 0), deadline(deadline){
+        for(int cell = 0; cell < SudokuRules::nCells; cell++){
+            values[cell] = 0;
+            // like SudokuRules::isValid, anything outside of 1..9 (UNASSIGNED, 0) is an empty cell
+            int value = grid[cell / Sudoku::N][cell % Sudoku::N];
+            if(value >= 1 && value <= Sudoku::N) place(cell, value);
+        }
+    }
 
-    // check small box
-    int smallBoxR = row / 3;
-    int smallBoxC = col / 3;
-    for(int r=smallBoxR*3; r<(smallBoxR+1)*3; r++)
-        for(int c=smallBoxC*3; c<(smallBoxC+1)*3; c++)
-            if((r != row && c != col) && grid[r][c] == value)
-                return false;
+    void place(int cell, int value){
+        values[cell] = value;
+        for(const int* u = rules.unitsBegin(cell); u != rules.unitsEnd(cell); u++){
+            used[*u] |= 1 << (value - 1);
+            usedSum[*u] += value;
+        }
+    }
 
-    return true;
+    void remove(int cell){
+        int value = values[cell];
+        values[cell] = 0;
+        for(const int* u = rules.unitsBegin(cell); u != rules.unitsEnd(cell); u++){
+            used[*u] &= ~(1 << (value - 1));
+            usedSum[*u] -= value;
+        }
+    }
+
+    // digits allowed by all units of the cell
+    int candidates(int cell) const{
+        int mask = SudokuRules::allDigits;
+        for(const int* u = rules.unitsBegin(cell); u != rules.unitsEnd(cell); u++) mask &= ~used[*u];
+        if(!rules.hasSumUnit(cell)) return mask;
+        for(const int* u = rules.unitsBegin(cell); u != rules.unitsEnd(cell) && mask; u++){
+            if(rules.getUnit(*u).sum) mask &= rules.sumCandidates(*u, used[*u], usedSum[*u]);
+        }
+        return mask;
+    }
+};
+
+// depth-first search over the empty cells in row-major order, smallest digit first
+static bool search(SearchState& state, int cell, int& nIters, int& nDeadEnds){
+    nIters++;
+    if(state.deadline && nIters % Deadline::checkInterval == 0 && state.deadline->expired()){
+        state.stopped = true;
+        return false;
+    }
+    while(cell < SudokuRules::nCells && state.values[cell]) cell++;
+    if(cell == SudokuRules::nCells){
+        return true; // done
+    }
+
+    for(int candidates = state.candidates(cell); candidates; candidates &= candidates - 1){
+        int value = __builtin_ctz(candidates) + 1;
+        state.place(cell, value);
+        if(search(state, cell + 1, nIters, nDeadEnds))
+            return true;
+        // if cant solve, take it back so the next round can try another digit
+        state.remove(cell);
+        if(state.stopped)
+            return false;
+    }
+    nDeadEnds++;
+    return false;
 }
 
 // members
@@ -54,6 +103,12 @@ Sudoku::Sudoku(const Sudoku& other){
     this->grid = other.grid;
     this->probabilities = other.probabilities;
     this->nIters = other.nIters;
+    this->nConflicts = other.nConflicts;
+    this->backend = other.backend;
+    this->lastResolve = other.lastResolve;
+    this->deadline = other.deadline;
+    this->rules = other.rules;
+    this->givens = other.givens;
 }
 
 bool Sudoku::fill(int row, int col, int value, double probability){
@@ -78,50 +133,160 @@ double Sudoku::getJoinProbability() const {
 }
 
 bool Sudoku::isValid() const {
-    for(int row = 0; row < Sudoku::N; row++)
-        for(int col = 0; col < Sudoku::N; col++)
-            if(grid[row][col] != UNASSIGNED && !isValidEntry(grid, row, col, grid[row][col]))
-                return false;
-    return true;
+    // on the stack, it is called for every candidate puzzle of every frame
+    int values[SudokuRules::nCells];
+    for(int cell = 0; cell < SudokuRules::nCells; cell++) values[cell] = grid[cell / N][cell % N];
+    return rules->isValid(values);
 }
 
 
 
 bool Sudoku::solve(){
+    TRACE_SCOPE("Sudoku::solve");
     if(!isValid()){
-        cout << "Starting Sudoku puzzle is NOT valid." << endl;
+        cerr << "Starting Sudoku puzzle is NOT valid." << endl;
         throw exception();
     }
     if(this->solved)
         return true;
 
     this->nIters =0;
-    cout << "Solving Sudoku ...";
+    this->nConflicts = 0;
+    this->stopped = false;
+    for(int cell = 0; cell < SudokuRules::nCells; cell++){
+        int value = grid[cell / N][cell % N];
+        givens[cell] = value >= 1 && value <= N ? value : 0;
+    }
     this->solved = this->trySolve(this->grid);
+    return this->solved;
+}
+
+bool Sudoku::resolve(const vector<CellChange>& changes){
+    TRACE_SCOPE("Sudoku::resolve");
+    this->nIters = 0;
+    this->nConflicts = 0;
+    this->stopped = false;
+    this->lastResolve = FULL;
+    if(!this->solved){
+        for(auto& change: changes){
+            bool given = change.value >= 1 && change.value <= N;
+            grid[change.row][change.col] = given ? change.value : UNASSIGNED;
+            probabilities[change.row][change.col] = given ? change.probability : UNASSIGNED;
+        }
+        return isValid() && solve();
+    }
+
+    // fast path: a solution that agrees with every changed given is still a solution
+    vector<int> changed;
+    for(auto& change: changes){
+        int cell = change.row * N + change.col;
+        bool given = change.value >= 1 && change.value <= N;
+        givens[cell] = given ? change.value : 0;
+        probabilities[change.row][change.col] = given ? change.probability : UNASSIGNED;
+        if(given && grid[change.row][change.col] != change.value) changed.push_back(cell);
+    }
+    if(changed.empty()){
+        this->lastResolve = REUSED;
+        return true;
+    }
 
-    cout << " done! Ran in " << this->nIters << " iterations." << endl;
+    for(int cell: changed){
+        for(int peer: rules->getPeers(cell)){
+            if(givens[peer] == givens[cell]){
+                restoreGivens();
+                return false;
+            }
+        }
+    }
+
+    /**
+     * Putting digit b where the solution has a only needs the cells holding a or b to be
+     * rearranged (an a/b swap along a cycle of units), all other cells keep their digits.
+     * Freeing the peers of the changed cells instead hardly ever works: every other unit
+     * through them is still full and has no place for the displaced digit.
+     */
+    int digits = 0;
+    for(int cell: changed) digits |= (1 << (givens[cell] - 1)) | (1 << (grid[cell / N][cell % N] - 1));
+    // with more than half of the digits free the local search is hardly smaller than the full one
+    vector<vector<int> > local(grid);
+    if(__builtin_popcount(digits) <= N / 2 && localSearch(digits, local)) return true;
+    // a given blocks the swap, a third digit often makes room; each try only searches 27 cells,
+    // none starts once the deadline stopped a search
+    for(int third = 0; third < N && !this->stopped && __builtin_popcount(digits) < 3; third++){
+        if(!(digits & (1 << third)) && localSearch(digits | (1 << third), local)) return true;
+    }
+    restoreGivens();
+    if(this->stopped || !isValid())
+        return false;
+
+    // the kept digits ruled out every solution, search the whole puzzle
+    this->solved = trySolve(this->grid);
     return this->solved;
 }
 
-bool Sudoku::trySolve(vector<vector<int> >& grid){
-    this->nIters++;
-    int row, col;
-    if(!findNextCell(grid, row, col)){
-        return true; // done
+bool Sudoku::localSearch(int digits, vector<vector<int> >& local){
+    for(int cell = 0; cell < SudokuRules::nCells; cell++){
+        int value = grid[cell / N][cell % N];
+        if(givens[cell]) local[cell / N][cell % N] = givens[cell];
+        else local[cell / N][cell % N] = digits & (1 << (value - 1)) ? UNASSIGNED : value;
     }
-    
-    // try all numbers in the next free cell
-    for(int value=1; value<10; value++){
-        // basic check to see if it makes sense to continue
-        if(isValidEntry(grid, row, col, value)){
-            grid[row][col] = value;
-            if(trySolve(grid))
-                return true;
-            // if cant solve, put it back to unassigned so the next round can try it out
-            grid[row][col] = UNASSIGNED;
+    if(!trySolve(local))
+        return false;
+    grid.swap(local);
+    this->lastResolve = LOCAL;
+    return true;
+}
+
+void Sudoku::restoreGivens(){
+    for(int cell = 0; cell < SudokuRules::nCells; cell++)
+        grid[cell / N][cell % N] = givens[cell] ? givens[cell] : UNASSIGNED;
+    this->solved = false;
+}
+
+bool Sudoku::trySolve(vector<vector<int> >& grid){
+    if(this->backend == CDCL){
+        int values[SudokuRules::nCells];
+        for(int cell = 0; cell < SudokuRules::nCells; cell++){
+            int value = grid[cell / N][cell % N];
+            values[cell] = value == UNASSIGNED ? 0 : value;
         }
+        CdclSolver solver(*rules, deadline);
+        bool solvable = solver.solve(values);
+        this->nIters += (int)solver.getStats().decisions;
+        this->nConflicts += (int)solver.getStats().conflicts;
+        this->stopped = solver.isStopped();
+        if(!solvable)
+            return false;
+        for(int cell = 0; cell < SudokuRules::nCells; cell++)
+            grid[cell / N][cell % N] = values[cell];
+        return true;
     }
-    return false;
+
+    /**
+     * The used digits of every unit are kept as bitmasks, so the candidates of a cell are
+     * the complement of the masks of its (precomputed) units instead of a scan of its peers.
+     */
+    SearchState state(*rules, grid, deadline);
+    bool solvable = search(state, 0, this->nIters, this->nConflicts);
+    this->stopped = state.stopped;
+    if(!solvable)
+        return false;
+    for(int cell = 0; cell < SudokuRules::nCells; cell++)
+        grid[cell / N][cell % N] = state.values[cell];
+    return true;
+}
+
+void Sudoku::reset(const int* values){
+    for(int row = 0; row < N; row++){
+        int* cells = grid[row].data();
+        for(int col = 0; col < N; col++) cells[col] = values[row * N + col] > 0 ? values[row * N + col] : UNASSIGNED;
+        std::fill(probabilities[row].begin(), probabilities[row].end(), (double)UNASSIGNED);
+    }
+    std::fill(givens.begin(), givens.end(), 0);
+    this->solved = false;
+    this->stopped = false;
+    this->nIters = 0;
+    this->nConflicts = 0;
 }
 
 void Sudoku::print() const { 
@@ -0,0 +1,184 @@
+#include "SudokuRules.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+// helpers
+static int countDigits(int mask){
+    int n = 0;
+    for(; mask; mask &= mask - 1) n++;
+    return n;
+}
+
+static int digitSum(int mask){
+    int sum = 0;
+    for(int d = 1; d <= SudokuRules::N; d++)
+        if(mask & (1 << (d - 1))) sum += d;
+    return sum;
+}
+
+// all digit masks with the given number of digits and sum, built once
+static const vector<int>& digitCombinations(int nDigits, int sum){
+    static const int maxSum = SudokuRules::N * (SudokuRules::N + 1) / 2;
+    static const vector<vector<vector<int> > > table = [](){
+        vector<vector<vector<int> > > combinations(SudokuRules::N + 1, vector<vector<int> >(maxSum + 1));
+        for(int mask = 0; mask <= SudokuRules::allDigits; mask++){
+            combinations[countDigits(mask)][digitSum(mask)].push_back(mask);
+        }
+        return combinations;
+    }();
+    static const vector<int> none;
+    if(nDigits < 0 || nDigits > SudokuRules::N || sum < 0 || sum > maxSum) return none;
+    return table[nDigits][sum];
+}
+
+// members
+SudokuRules::SudokuRules(){
+    for(int i = 0; i < N; i++){
+        Unit row, col, box;
+        for(int j = 0; j < N; j++){
+            row.cells.push_back(i * N + j);
+            col.cells.push_back(j * N + i);
+            box.cells.push_back((i / 3 * 3 + j / 3) * N + i % 3 * 3 + j % 3);
+        }
+        units.push_back(row);
+        units.push_back(col);
+        units.push_back(box);
+    }
+    compile();
+}
+
+shared_ptr<const SudokuRules> SudokuRules::classic(){
+    static const shared_ptr<const SudokuRules> rules = make_shared<const SudokuRules>();
+    return rules;
+}
+
+void SudokuRules::addDiagonals(){
+    Unit mainDiagonal, antiDiagonal;
+    for(int i = 0; i < N; i++){
+        mainDiagonal.cells.push_back(i * N + i);
+        antiDiagonal.cells.push_back(i * N + N - 1 - i);
+    }
+    units.push_back(mainDiagonal);
+    units.push_back(antiDiagonal);
+    classicRules = false;
+    compile();
+}
+
+void SudokuRules::setRegions(const vector<int>& regions){
+    if(regions.size() != (size_t)nCells){
+        cerr << "Jigsaw regions need one entry per cell, got " << regions.size() << endl;
+        throw exception();
+    }
+    vector<Unit> newRegions(N);
+    for(int cell = 0; cell < nCells; cell++){
+        if(regions[cell] < 0 || regions[cell] >= N){
+            cerr << "Invalid region " << regions[cell] << " of cell " << cell << endl;
+            throw exception();
+        }
+        newRegions[regions[cell]].cells.push_back(cell);
+    }
+    for(auto& region: newRegions){
+        if(region.cells.size() != (size_t)N){
+            cerr << "Every jigsaw region needs " << N << " cells" << endl;
+            throw exception();
+        }
+    }
+
+    // the boxes are every third unit of the classic ones
+    for(int i = 0; i < N; i++) units[i * 3 + 2] = newRegions[i];
+    classicRules = false;
+    compile();
+}
+
+void SudokuRules::addCage(const vector<int>& cells, int sum){
+    if(sum <= 0){
+        cerr << "A cage needs a positive sum" << endl;
+        throw exception();
+    }
+    addUnit(cells, sum);
+}
+
+void SudokuRules::addUnit(const vector<int>& cells, int sum){
+    if(cells.empty() || cells.size() > (size_t)N){
+        cerr << "A unit needs between 1 and " << N << " cells" << endl;
+        throw exception();
+    }
+    // a cell listed twice would have to differ from itself
+    vector<char> listed(nCells, 0);
+    for(int cell: cells){
+        if(cell < 0 || cell >= nCells){
+            cerr << "Invalid cell " << cell << endl;
+            throw exception();
+        }
+        if(listed[cell]){
+            cerr << "Cell " << cell << " is listed twice in a unit" << endl;
+            throw exception();
+        }
+        listed[cell] = 1;
+    }
+    Unit unit;
+    unit.cells = cells;
+    unit.sum = sum;
+    units.push_back(unit);
+    classicRules = false;
+    compile();
+}
+
+void SudokuRules::compile(){
+    vector<vector<int> > unitsOfCell(nCells);
+    for(int u = 0; u < (int)units.size(); u++){
+        for(int cell: units[u].cells) unitsOfCell[cell].push_back(u);
+    }
+
+    cellUnitOffsets.assign(1, 0);
+    cellUnits.clear();
+    sumCells.assign(nCells, 0);
+    for(int cell = 0; cell < nCells; cell++){
+        for(int u: unitsOfCell[cell]){
+            cellUnits.push_back(u);
+            if(units[u].sum) sumCells[cell] = 1;
+        }
+        cellUnitOffsets.push_back((int)cellUnits.size());
+    }
+
+    peers.assign(nCells, vector<int>());
+    for(int cell = 0; cell < nCells; cell++){
+        vector<char> isPeer(nCells, 0);
+        for(int u: unitsOfCell[cell])
+            for(int other: units[u].cells)
+                isPeer[other] = other != cell;
+        for(int other = 0; other < nCells; other++)
+            if(isPeer[other]) peers[cell].push_back(other);
+    }
+}
+
+int SudokuRules::sumCandidates(int unit, int usedMask, int usedSum) const{
+    const Unit& u = units[unit];
+    int nFree = (int)u.cells.size() - countDigits(usedMask);
+    int candidates = 0;
+    for(int combination: digitCombinations(nFree, u.sum - usedSum)){
+        if(!(combination & usedMask)) candidates |= combination;
+    }
+    return candidates;
+}
+
+bool SudokuRules::isValid(const int values[nCells]) const{
+    for(int u = 0; u < (int)units.size(); u++){
+        int usedMask = 0, usedSum = 0;
+        for(int cell: units[u].cells){
+            int value = values[cell];
+            if(value < 1 || value > N) continue;
+            int bit = 1 << (value - 1);
+            if(usedMask & bit) return false;
+            usedMask |= bit;
+            usedSum += value;
+        }
+        if(units[u].sum == 0) continue;
+        bool complete = countDigits(usedMask) == (int)units[u].cells.size();
+        if(complete ? usedSum != units[u].sum : sumCandidates(u, usedMask, usedSum) == 0) return false;
+    }
+    return true;
+}
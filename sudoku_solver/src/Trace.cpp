@@ -0,0 +1,115 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+const chrono::steady_clock::time_point Trace::epoch = chrono::steady_clock::now();
+
+// helpers
+struct TraceEvent{
+    const char* name;
+    int64_t start;
+    int64_t duration;
+};
+
+// written only by its own thread, read when exporting
+struct TraceBuffer{
+    int tid;
+    atomic<size_t> written{0};
+    unique_ptr<TraceEvent[]> events{new TraceEvent[Trace::bufferCapacity]};
+};
+
+// buffers are never freed, so that spans of finished threads can still be exported
+static mutex buffersMutex;
+static vector<TraceBuffer*> buffers;
+
+static TraceBuffer* threadBuffer(){
+    thread_local TraceBuffer* buffer = nullptr;
+    if(!buffer){
+        buffer = new TraceBuffer();
+        lock_guard<mutex> lock(buffersMutex);
+        buffer->tid = (int)buffers.size() + 1;
+        buffers.push_back(buffer);
+    }
+    return buffer;
+}
+
+template <typename Visitor>
+static void forEachEvent(Visitor visit){
+    lock_guard<mutex> lock(buffersMutex);
+    for(TraceBuffer* buffer: buffers){
+        size_t written = buffer->written.load(memory_order_acquire);
+        size_t first = written > Trace::bufferCapacity ? written - Trace::bufferCapacity : 0;
+        for(size_t i = first; i < written; i++){
+            visit(buffer->tid, buffer->events[i % Trace::bufferCapacity]);
+        }
+    }
+}
+
+// members
+void Trace::record(const char* name, int64_t start, int64_t duration){
+    TraceBuffer* buffer = threadBuffer();
+    size_t written = buffer->written.load(memory_order_relaxed);
+    buffer->events[written % bufferCapacity] = {name, start, duration};
+    buffer->written.store(written + 1, memory_order_release);
+}
+
+bool Trace::writeChromeTrace(const string& path){
+    ofstream out(path);
+    if(!out) return false;
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    forEachEvent([&out, &first](int tid, const TraceEvent& event){
+        out << (first ? "\n" : ",\n")
+            << "{\"name\": \"" << event.name << "\", \"cat\": \"sudoku\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+            << ", \"ts\": " << event.start / 1000.0 << ", \"dur\": " << event.duration / 1000.0 << "}";
+        first = false;
+    });
+    out << "\n]}\n";
+    return (bool)out;
+}
+
+void Trace::printSummary(ostream& out){
+    struct Stats{
+        long count = 0;
+        int64_t total = 0;
+        int64_t max = 0;
+    };
+    map<string, Stats> stages;
+    forEachEvent([&stages](int, const TraceEvent& event){
+        Stats& stats = stages[event.name];
+        stats.count++;
+        stats.total += event.duration;
+        stats.max = std::max(stats.max, event.duration);
+    });
+
+    // most expensive stages first
+    vector<pair<string, Stats> > sorted(stages.begin(), stages.end());
+    sort(sorted.begin(), sorted.end(), [](const pair<string, Stats>& left, const pair<string, Stats>& right) {
+        return left.second.total > right.second.total;
+    });
+
+    out << "stage                          count    total [ms]     mean [ms]      max [ms]" << endl;
+    for(auto& stage: sorted){
+        const Stats& stats = stage.second;
+        char line[160];
+        snprintf(line, sizeof(line), "%-28s %7ld %13.3f %13.4f %13.4f", stage.first.c_str(), stats.count,
+                 stats.total / 1e6, stats.total / 1e6 / stats.count, stats.max / 1e6);
+        out << line << endl;
+    }
+}
+
+void Trace::clear(){
+    lock_guard<mutex> lock(buffersMutex);
+    for(TraceBuffer* buffer: buffers){
+        buffer->written.store(0, memory_order_release);
+    }
+}
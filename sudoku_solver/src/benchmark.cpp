@@ -0,0 +1,477 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+#include "Sudoku.hpp"
+#include "ImgProc.hpp"
+#include "MnistModel.hpp"
+#include "CellReader.hpp"
+#include "BatchPipeline.hpp"
+#include "Pipeline.hpp"
+#include "FrameContext.hpp"
+#include "AllocationCounter.hpp"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Accuracy and latency regression benchmark. Runs the whole pipeline headlessly over a directory
+ * of images, each stage timed on its own, and compares the recognized digits with a ground-truth
+ * file next to the image (sudoku10.png -> sudoku10.txt: 9 lines of 9 characters, '.' or '0' for
+ * empty cells). The report is JSON with a fixed key order so that two builds can be diffed.
+ * A ground truth with several grids, in reading order, marks a page: it is solved by
+ * solveImageGrids and its cost is reported per grid next to the cost of the single images.
+ */
+
+#ifdef SUDOKU_COUNT_ALLOCATIONS
+// counts every heap allocation of the process for the --frames report
+static const bool countsHeap = true;
+
+void* operator new(size_t size){
+    AllocationCounter::countHeapAllocation();
+    void* p = malloc(size ? size : 1);
+    if(!p) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept{
+    free(p);
+}
+#else
+static const bool countsHeap = false;
+#endif
+
+const vector<string> stageNames = {"read", "vision", "clean", "recognition", "candidates", "solve"};
+
+struct StageSample{
+    double ms = 0;
+    // high-water mark of the resident set size of the process (ru_maxrss) once the stage is done,
+    // it includes everything before the stage
+    long maxRssKb = 0;
+    // how much the stage raised that high-water mark, 0 if it stayed below the earlier peak
+    long maxRssGrowthKb = 0;
+};
+
+struct ImageReport{
+    string path;
+    bool hasGroundTruth = false;
+    bool gridFound = false;
+    // cells whose digit (or emptiness) matches the ground truth
+    int cellsCorrect = 0;
+    // digits that were not found, found in empty cells or classified wrongly
+    int missedDigits = 0;
+    int spuriousDigits = 0;
+    int wrongDigits = 0;
+    size_t nCandidates = 0;
+    bool solved = false;
+    // most probable solution agrees with all ground-truth digits
+    bool solvedCorrectly = false;
+    // repetitions that ran out of the --budget, and where the last one stopped
+    int stopped = 0;
+    string stoppedStage;
+    // per stage, one sample per repetition
+    vector<vector<StageSample> > samples = vector<vector<StageSample> >(stageNames.size());
+
+    // the same image processed over and over by one FrameContext, like frames of a video
+    int frames = 0;
+    FrameAllocations firstFrame;
+    // the most any later frame allocated, 0 once the buffers are sized
+    FrameAllocations laterFrames;
+    vector<double> frameMs;
+};
+
+struct PageReport{
+    string path;
+    int grids = 0;
+    int gridsFound = 0;
+    // over all grids of the ground truth, a grid that was not found has no correct cell
+    int cellsCorrect = 0;
+    int solvedCorrectly = 0;
+    int stopped = 0;
+    // whole page without imread, one per repetition
+    vector<double> ms;
+};
+
+long maxRssKb(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double median(vector<double> values){
+    if(values.empty()) return 0;
+    sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+// one string of 81 cells per grid
+bool readGroundTruth(const string& imagePath, vector<string>& grids){
+    string path = imagePath.substr(0, imagePath.find_last_of('.')) + ".txt";
+    ifstream file(path);
+    if(!file) return false;
+    string digits;
+    char c;
+    while(file.get(c)){
+        if(c == '.' || c == '0') digits += '.';
+        else if(c >= '1' && c <= '9') digits += c;
+    }
+    if(digits.empty() || digits.size() % CellReader::nCells != 0){
+        cerr << "Ignoring " << path << ", it does not contain a multiple of 81 cells" << endl;
+        return false;
+    }
+    grids.clear();
+    for(size_t start=0; start<digits.size(); start+=CellReader::nCells) grids.push_back(digits.substr(start, CellReader::nCells));
+    return true;
+}
+
+void compareDigits(const CellReader::CellResults& cells, const string& truth, ImageReport& report){
+    report.cellsCorrect = report.missedDigits = report.spuriousDigits = report.wrongDigits = 0;
+    for(auto& cell: cells){
+        char expected = truth[cell.row * Sudoku::N + cell.col];
+        if(!cell.hasDigit() || cell.candidates.empty()){
+            if(expected == '.') report.cellsCorrect++;
+            else report.missedDigits++;
+        } else if(expected == '.'){
+            report.spuriousDigits++;
+        } else if(cell.candidates[0].first == expected - '0'){
+            report.cellsCorrect++;
+        } else{
+            report.wrongDigits++;
+        }
+    }
+}
+
+bool agreesWith(const Sudoku& solution, const string& truth){
+    for(int row=0; row<Sudoku::N; row++){
+        for(int col=0; col<Sudoku::N; col++){
+            char expected = truth[row * Sudoku::N + col];
+            if(expected != '.' && solution.getValue(row, col) != expected - '0') return false;
+        }
+    }
+    return true;
+}
+
+// truth is empty without ground truth
+void runImage(const string& path, const string& truth, MnistModel& model, const ImgProcParams& params, int repeat,
+              double budgetMs, ImageReport& report){
+    report.path = path;
+    report.hasGroundTruth = !truth.empty();
+
+    for(int r=0; r<repeat; r++){
+        // stages that notice the deadline stop early, the later ones then skip their work
+        Deadline deadline(budgetMs);
+        string stopStage;
+        vector<StageSample> stages(stageNames.size());
+        size_t stage = 0;
+        auto last = chrono::steady_clock::now();
+        long lastRssKb = maxRssKb();
+        auto endStage = [&](){
+            auto now = chrono::steady_clock::now();
+            stages[stage].ms = chrono::duration<double, milli>(now - last).count();
+            stages[stage].maxRssKb = maxRssKb();
+            stages[stage].maxRssGrowthKb = stages[stage].maxRssKb - lastRssKb;
+            lastRssKb = stages[stage].maxRssKb;
+            // the first stage that noticed the deadline
+            if(stopStage.empty() && deadline.stopReason() != Deadline::NONE) stopStage = stageNames[stage];
+            last = now;
+            stage++;
+        };
+
+        Mat img = imread(path, IMREAD_GRAYSCALE);
+        endStage();
+        if(img.empty()) break;
+
+        ImgProc processor(img, params);
+        try{
+            processor.run(&deadline);
+        } catch(DeadlineExceeded&){
+            report.gridFound = false;
+            report.stopped++;
+            report.stoppedStage = stageNames[stage];
+            DeadlineMetrics::record(deadline);
+            continue;
+        } catch(exception&){
+            report.gridFound = false;
+            break;
+        }
+        report.gridFound = true;
+        endStage();
+
+        CellReader::CellResults cells;
+        CellReader::clean(processor, cells, &deadline);
+        endStage();
+
+        vector<Mat> digits = CellReader::digitImages(processor, cells);
+        if(!digits.empty() && !deadline.expired()){
+            vector<vector<pair<int, float> > > recognized = model.inferClasses(digits);
+            CellReader::assign(cells, recognized.data());
+        }
+        endStage();
+
+        vector<Sudoku> possibleGames = CellReader::candidateGames(cells, &deadline);
+        report.nCandidates = possibleGames.size();
+        endStage();
+
+        vector<Sudoku> solutions = solveCandidates(possibleGames, 1, Sudoku::DFS, &deadline);
+        endStage();
+        if(!stopStage.empty() && solutions.empty()){
+            report.stopped++;
+            report.stoppedStage = stopStage;
+        }
+        DeadlineMetrics::record(deadline);
+
+        for(size_t s=0; s<stages.size(); s++) report.samples[s].push_back(stages[s]);
+        report.solved = !solutions.empty();
+        if(report.hasGroundTruth){
+            compareDigits(cells, truth, report);
+            report.solvedCorrectly = report.solved && agreesWith(solutions[0], truth);
+        }
+    }
+}
+
+void runPage(const string& path, const vector<string>& truths, MnistModel& model, const ImgProcParams& params,
+             int repeat, double budgetMs, PageReport& report){
+    report.path = path;
+    report.grids = truths.size();
+    Mat img = imread(path, IMREAD_GRAYSCALE);
+    if(img.empty()) return;
+
+    SolveOptions options;
+    options.imgProcParams = params;
+    options.model = &model;
+    // like the single images, one solver thread per grid
+    options.solverThreads = 1;
+    options.budgetMs = budgetMs;
+    for(int r=0; r<repeat; r++){
+        auto start = chrono::steady_clock::now();
+        PageResult page = solveImageGrids(img, options);
+        report.ms.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+        report.stopped += page.isStopped();
+
+        // the grids are found in reading order, the order of the ground truth
+        report.gridsFound = page.grids.size();
+        report.cellsCorrect = report.solvedCorrectly = 0;
+        for(size_t g=0; g<page.grids.size() && g<truths.size(); g++){
+            ImageReport grid;
+            compareDigits(page.grids[g].cells, truths[g], grid);
+            report.cellsCorrect += grid.cellsCorrect;
+            report.solvedCorrectly += page.grids[g].isSolved() && agreesWith(page.grids[g].solutions[0], truths[g]);
+        }
+    }
+}
+
+void runFrames(const string& path, const ImgProcParams& params, int frames, ImageReport& report){
+    Mat img = imread(path, IMREAD_GRAYSCALE);
+    if(img.empty()) return;
+
+    FrameContext context(params);
+    report.frames = frames;
+    for(int f=0; f<frames; f++){
+        auto start = chrono::steady_clock::now();
+        context.process(img);
+        report.frameMs.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+        const FrameAllocations& allocations = context.getLastAllocations();
+        if(f == 0){
+            report.firstFrame = allocations;
+        } else{
+            report.laterFrames.heap = max(report.laterFrames.heap, allocations.heap);
+            report.laterFrames.mats = max(report.laterFrames.mats, allocations.mats);
+        }
+    }
+}
+
+void writeStages(ostream& json, const vector<vector<StageSample> >& samples, const string& indent){
+    json << "{";
+    for(size_t s=0; s<stageNames.size(); s++){
+        vector<double> ms;
+        long maxKb = 0, growthKb = 0;
+        for(auto& sample: samples[s]){
+            ms.push_back(sample.ms);
+            maxKb = max(maxKb, sample.maxRssKb);
+            growthKb = max(growthKb, sample.maxRssGrowthKb);
+        }
+        json << (s == 0 ? "\n" : ",\n") << indent << "  \"" << stageNames[s] << "\": {\"medianMs\": " << median(ms)
+             << ", \"minMs\": " << (ms.empty() ? 0 : *min_element(ms.begin(), ms.end()))
+             << ", \"maxRssKb\": " << maxKb << ", \"maxRssGrowthKb\": " << growthKb << "}";
+    }
+    json << "\n" << indent << "}";
+}
+
+// median over the repetitions of all images of vision to solve, what solveImageGrids does per page
+double singleImageMs(const vector<ImageReport>& reports){
+    vector<double> totals;
+    for(auto& report: reports){
+        for(size_t r=0; r<report.samples[0].size(); r++){
+            double ms = 0;
+            for(size_t s=1; s<stageNames.size(); s++) ms += report.samples[s][r].ms;
+            totals.push_back(ms);
+        }
+    }
+    return median(totals);
+}
+
+void writePages(ostream& json, const vector<PageReport>& pages, double singleMs){
+    json << ",\n  \"singleImageMs\": " << singleMs << ",\n  \"pages\": [";
+    for(size_t i=0; i<pages.size(); i++){
+        const PageReport& page = pages[i];
+        double ms = median(page.ms);
+        double perGridMs = page.gridsFound ? ms / page.gridsFound : 0;
+        json << (i == 0 ? "\n" : ",\n") << "    {\"image\": \"" << BatchPipeline::jsonEscape(page.path) << "\""
+             << ", \"grids\": " << page.grids << ", \"gridsFound\": " << page.gridsFound
+             << ", \"cellAccuracy\": " << (double)page.cellsCorrect / (page.grids * CellReader::nCells)
+             << ", \"solvedCorrectly\": " << page.solvedCorrectly << ", \"stopped\": " << page.stopped
+             << ", \"medianMs\": " << ms << ", \"perGridMs\": " << perGridMs
+             << ", \"perGridVsSingle\": " << (singleMs > 0 ? perGridMs / singleMs : 0) << "}";
+    }
+    json << "\n  ]";
+}
+
+void writeReport(ostream& json, const vector<ImageReport>& reports, const vector<PageReport>& pages, int repeat,
+                 double budgetMs){
+    json << fixed << setprecision(3);
+    json << "{\n  \"repeat\": " << repeat << ",\n  \"budgetMs\": " << budgetMs << ",\n  \"countsHeapAllocations\": "
+         << (countsHeap ? "true" : "false") << ",\n  \"images\": [";
+
+    int nTruth = 0, nFound = 0, nSolved = 0, nCorrect = 0, cellsCorrect = 0;
+    vector<vector<StageSample> > allSamples(stageNames.size());
+    for(size_t i=0; i<reports.size(); i++){
+        const ImageReport& report = reports[i];
+        json << (i == 0 ? "\n" : ",\n") << "    {\n      \"image\": \"" << BatchPipeline::jsonEscape(report.path) << "\",\n"
+             << "      \"gridFound\": " << (report.gridFound ? "true" : "false") << ",\n";
+        if(report.hasGroundTruth){
+            json << "      \"cellAccuracy\": " << (double)report.cellsCorrect / CellReader::nCells << ",\n"
+                 << "      \"missedDigits\": " << report.missedDigits << ",\n"
+                 << "      \"spuriousDigits\": " << report.spuriousDigits << ",\n"
+                 << "      \"wrongDigits\": " << report.wrongDigits << ",\n";
+        }
+        json << "      \"candidates\": " << report.nCandidates << ",\n"
+             << "      \"solved\": " << (report.solved ? "true" : "false") << ",\n";
+        if(report.hasGroundTruth){
+            json << "      \"solvedCorrectly\": " << (report.solvedCorrectly ? "true" : "false") << ",\n";
+        }
+        if(budgetMs > 0){
+            json << "      \"stopped\": " << report.stopped;
+            if(report.stopped) json << ", \"stoppedIn\": \"" << report.stoppedStage << "\"";
+            json << ",\n";
+        }
+        if(report.frames > 0){
+            json << "      \"frames\": {\"count\": " << report.frames
+                 << ", \"medianMs\": " << median(report.frameMs)
+                 << ", \"firstHeapAllocations\": " << report.firstFrame.heap
+                 << ", \"firstMatAllocations\": " << report.firstFrame.mats
+                 << ", \"laterHeapAllocations\": " << report.laterFrames.heap
+                 << ", \"laterMatAllocations\": " << report.laterFrames.mats << "},\n";
+        }
+        json << "      \"stages\": ";
+        writeStages(json, report.samples, "      ");
+        json << "\n    }";
+
+        nFound += report.gridFound;
+        nSolved += report.solved;
+        if(report.hasGroundTruth){
+            nTruth++;
+            nCorrect += report.solvedCorrectly;
+            cellsCorrect += report.cellsCorrect;
+        }
+        for(size_t s=0; s<stageNames.size(); s++){
+            allSamples[s].insert(allSamples[s].end(), report.samples[s].begin(), report.samples[s].end());
+        }
+    }
+
+    json << "\n  ],\n  \"summary\": {\n"
+         << "    \"images\": " << reports.size() << ",\n"
+         << "    \"withGroundTruth\": " << nTruth << ",\n"
+         << "    \"gridsFound\": " << nFound << ",\n"
+         << "    \"solved\": " << nSolved << ",\n"
+         << "    \"solvedCorrectly\": " << nCorrect << ",\n"
+         << "    \"cellAccuracy\": " << (nTruth ? (double)cellsCorrect / (nTruth * CellReader::nCells) : 0) << ",\n"
+         << "    \"stages\": ";
+    writeStages(json, allSamples, "    ");
+    if(budgetMs > 0){
+        DeadlineMetrics::Snapshot deadlines = DeadlineMetrics::snapshot();
+        json << ",\n    \"deadlines\": {\"runs\": " << deadlines.bounded
+             << ", \"timedOut\": " << deadlines.timedOut
+             << ", \"overrunRate\": " << deadlines.overrunRate()
+             << ", \"meanOverrunMs\": " << deadlines.meanOverrunMs()
+             << ", \"maxOverrunMs\": " << deadlines.maxOverrunMs << "}";
+    }
+    json << "\n  }";
+    if(!pages.empty()) writePages(json, pages, singleImageMs(reports));
+    json << "\n}\n";
+}
+
+int main(int argc, char *argv[]){
+    string input;
+    // not stdout, the model and the image processing print diagnostics there
+    string reportPath = "report.json";
+    int repeat = 5;
+    int frames = 0;
+    double budgetMs = 0;
+    ImgProcParams params;
+    for(int a=1; a<argc; a++){
+        string arg = argv[a];
+        if(arg == "--repeat" && a+1 < argc) repeat = max(1, stoi(argv[++a]));
+        else if(arg == "--out" && a+1 < argc) reportPath = argv[++a];
+        else if(arg == "--frames" && a+1 < argc) frames = stoi(argv[++a]);
+        else if(arg == "--max-side" && a+1 < argc) params.detectionMaxSide = stoi(argv[++a]);
+        else if(arg == "--budget" && a+1 < argc) budgetMs = stod(argv[++a]);
+        else input = arg;
+    }
+    if(input.empty()){
+        cout << "Usage: SudokuBenchmark [--repeat N] [--frames N] [--max-side N] [--budget MS] [--out report.json] dir|manifest" << endl;
+        return -1;
+    }
+
+    vector<string> paths;
+    try{
+        paths = BatchPipeline::listImages(input);
+    } catch(exception&){
+        return -1;
+    }
+    MnistModel& model = MnistModel::getInstance();
+    // the first inference loads the model, keep it out of the measurements
+    Mat blank = Mat::zeros(MnistModel::inputSize, MnistModel::inputSize, CV_8UC1);
+    model.inferClasses({blank});
+
+    vector<ImageReport> reports;
+    vector<PageReport> pages;
+    for(auto& path: paths){
+        cerr << "Benchmarking " << path << endl;
+        vector<string> truths;
+        readGroundTruth(path, truths);
+        if(truths.size() > 1){
+            pages.emplace_back();
+            runPage(path, truths, model, params, repeat, budgetMs, pages.back());
+            continue;
+        }
+        reports.emplace_back();
+        runImage(path, truths.empty() ? string() : truths[0], model, params, repeat, budgetMs, reports.back());
+        if(frames > 0) runFrames(path, params, frames, reports.back());
+    }
+
+    ofstream report(reportPath);
+    if(!report){
+        cerr << "Cannot write " << reportPath << endl;
+        return -1;
+    }
+    writeReport(report, reports, pages, repeat, budgetMs);
+    cerr << "Report written to " << reportPath << endl;
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "DaemonProtocol.hpp"
+
+using namespace std;
+
+/**
+ * Thin client for SudokuSolver --daemon. All requests are sent back-to-back (pipelined)
+ * while the responses are read on the main thread, then the latencies are reported.
+ */
+
+struct ClientRequest{
+    string label;
+    uint32_t type;
+    vector<char> payload;
+};
+
+bool isImagePath(const string& path){
+    string ext = path.substr(path.find_last_of('.') + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "png" || ext == "jpg" || ext == "jpeg" || ext == "bmp" || ext == "tif" || ext == "tiff";
+}
+
+void addRequests(const string& input, vector<ClientRequest>& requests){
+    if(input.size() == DaemonProtocol::nCells && input.find('/') == string::npos){
+        // the puzzle itself
+        requests.push_back({input, DaemonProtocol::PUZZLE, vector<char>(input.begin(), input.end())});
+        return;
+    }
+    ifstream file(input, ios::binary);
+    if(!file){
+        cout << "Cannot open " << input << endl;
+        return;
+    }
+    if(isImagePath(input)){
+        vector<char> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        requests.push_back({input, DaemonProtocol::IMAGE, bytes});
+        return;
+    }
+    // text file with one puzzle per line
+    string line;
+    int lineNr = 0;
+    while(getline(file, line)){
+        lineNr++;
+        if(line.size() < (size_t)DaemonProtocol::nCells) continue;
+        line.resize(DaemonProtocol::nCells);
+        requests.push_back({input + ":" + to_string(lineNr), DaemonProtocol::PUZZLE, vector<char>(line.begin(), line.end())});
+    }
+}
+
+double percentile(vector<double> values, double p){
+    sort(values.begin(), values.end());
+    return values[min(values.size() - 1, (size_t)(p * values.size()))];
+}
+
+int main(int argc, char *argv[]){
+    if(argc < 3){
+        cout << "Usage: SudokuClient SOCKET [--repeat N] [--quiet] image|puzzles.txt|puzzle ..." << endl;
+        return -1;
+    }
+    string socketPath = argv[1];
+    int repeat = 1;
+    bool quiet = false;
+    vector<ClientRequest> inputs;
+    for(int a=2; a<argc; a++){
+        string arg = argv[a];
+        if(arg == "--repeat" && a+1 < argc) repeat = stoi(argv[++a]);
+        else if(arg == "--quiet") quiet = true;
+        else addRequests(arg, inputs);
+    }
+    if(inputs.empty()) return -1;
+
+    int fd = DaemonProtocol::connectTo(socketPath);
+    if(fd < 0){
+        cout << "Cannot connect to " << socketPath << endl;
+        return -1;
+    }
+
+    const size_t nRequests = inputs.size() * repeat;
+    // send time of each request in ns, written by the sender and read when the response arrives
+    vector<atomic<long long> > sent(nRequests);
+    thread sender([&]{
+        for(size_t id=0; id<nRequests; id++){
+            const ClientRequest& request = inputs[id % inputs.size()];
+            sent[id] = chrono::steady_clock::now().time_since_epoch().count();
+            if(!DaemonProtocol::sendRequest(fd, request.type, (uint32_t)id, request.payload)) break;
+        }
+    });
+
+    vector<double> latencies;
+    vector<double> serviceTimes;
+    DaemonProtocol::Response response;
+    static const char* statusNames[] = {"solved", "no grid", "unsolvable", "bad request", "timed out", "failed"};
+    for(size_t i=0; i<nRequests && DaemonProtocol::receiveResponse(fd, response); i++){
+        long long received = chrono::steady_clock::now().time_since_epoch().count();
+        if(response.header.id >= nRequests){
+            cout << "Response with unknown id " << response.header.id << endl;
+            break;
+        }
+        latencies.push_back((received - sent[response.header.id]) / 1e6);
+        serviceTimes.push_back(response.header.serviceMicros / 1000.0);
+
+        if(quiet || response.header.id >= inputs.size()) continue;
+        cout << inputs[response.header.id].label << ": " << statusNames[min(response.header.status, 5u)] << endl;
+        for(int row=0; row<9; row++){
+            cout << "    " << string(response.grid + row * 9, 9) << endl;
+        }
+    }
+    sender.join();
+    close(fd);
+
+    if(latencies.empty()) return -1;
+    /**
+     * The daemon loaded the model in warmUp() before it accepted the connection, so the first
+     * request is not a cold start, it only pays for the first use of the connection. The later
+     * requests were pipelined behind it: their round trip includes the time they waited for the
+     * earlier ones, the daemon time does not.
+     */
+    double laterSum = 0, laterServiceSum = 0;
+    for(size_t i=1; i<latencies.size(); i++){
+        laterSum += latencies[i];
+        laterServiceSum += serviceTimes[i];
+    }
+    cout << "Requests: " << latencies.size() << endl;
+    cout << "First request on the connection: " << latencies[0] << " ms round trip (daemon: " << serviceTimes[0]
+         << " ms)" << endl;
+    if(latencies.size() > 1){
+        vector<double> later(latencies.begin() + 1, latencies.end());
+        cout << "Pipelined requests, round trip including queueing: mean " << laterSum / later.size()
+             << " ms, p50 " << percentile(later, 0.5) << " ms, p99 " << percentile(later, 0.99)
+             << " ms (daemon: mean " << laterServiceSum / later.size() << " ms)" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv4/opencv2/core.hpp>
+#include <opencv4/opencv2/imgcodecs.hpp>
+
+#include "DigitNet.hpp"
+#include "MnistModel.hpp"
+#include "FrameContext.hpp"
+#include "BatchPipeline.hpp"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Cost and accuracy of the digit-net variants (DigitNet::presets), to pick the smallest one that
+ * is accurate enough: parameters and FLOPs per digit, latency per cell with a full grid of 81
+ * digits and with a single one, accuracy on the MNIST test set and on the digits of images with
+ * ground truth (sudoku10.png -> sudoku10.txt, as for SudokuBenchmark).
+ */
+
+struct VariantReport{
+    DigitNetConfig config;
+    DigitNetCost cost;
+    bool hasModel = false;
+    double msPerCell = 0;
+    double msSingleCell = 0;
+    // -1 when not measured
+    double mnistAccuracy = -1;
+    double imageAccuracy = -1;
+};
+
+// the non-empty cells of all images with ground truth, digits are detected once for all variants
+struct LabelledDigits{
+    vector<Mat> images;
+    vector<int> labels;
+};
+
+double median(vector<double> values){
+    if(values.empty()) return 0;
+    sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+// false for pages with the ground truth of several grids, only one grid is labelled per image
+bool readGroundTruth(const string& imagePath, string& digits){
+    ifstream file(imagePath.substr(0, imagePath.find_last_of('.')) + ".txt");
+    if(!file) return false;
+    digits.clear();
+    char c;
+    while(file.get(c) && digits.size() <= (size_t)CellReader::nCells){
+        if(c == '.' || c == '0') digits += '.';
+        else if(c >= '1' && c <= '9') digits += c;
+    }
+    return digits.size() == (size_t)CellReader::nCells;
+}
+
+LabelledDigits collectDigits(const string& input){
+    LabelledDigits result;
+    FrameContext context;
+    for(const string& path: BatchPipeline::listImages(input)){
+        string truth;
+        Mat img = imread(path, IMREAD_GRAYSCALE);
+        if(!readGroundTruth(path, truth) || img.empty() || !context.process(img)) continue;
+
+        // the digits are views valid until the next frame, in the order of the cells
+        const vector<Mat>& digits = context.getDigits();
+        size_t d = 0;
+        for(auto& cell: context.getCells()){
+            if(!cell.hasDigit()) continue;
+            char expected = truth[cell.row * Sudoku::N + cell.col];
+            // digits found in empty cells are a matter of the cleaning, not of the net
+            if(expected != '.'){
+                result.images.push_back(digits[d].clone());
+                result.labels.push_back(expected - '0');
+            }
+            d++;
+        }
+    }
+    return result;
+}
+
+double timeInference(MnistModel& model, const vector<Mat>& digits, int repeat){
+    vector<double> ms;
+    for(int r=0; r<repeat; r++){
+        auto start = chrono::steady_clock::now();
+        model.inferClasses(digits);
+        ms.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    return median(ms);
+}
+
+void measure(VariantReport& report, const LabelledDigits& labelled, int repeat, bool mnist){
+    MnistModel model(report.config);
+    // random cells, the latency does not depend on what they show
+    vector<Mat> grid(CellReader::nCells);
+    for(Mat& cell: grid){
+        cell.create(MnistModel::inputSize, MnistModel::inputSize, CV_8UC1);
+        randu(cell, Scalar(0), Scalar(256));
+    }
+    // the first inference loads the model
+    model.inferClasses({grid[0]});
+    report.msPerCell = timeInference(model, grid, repeat) / grid.size();
+    report.msSingleCell = timeInference(model, {grid[0]}, repeat);
+
+    if(mnist) report.mnistAccuracy = model.testAccuracy();
+    if(!labelled.images.empty()){
+        vector<vector<pair<int, float> > > recognized = model.inferClasses(labelled.images);
+        int correct = 0;
+        for(size_t d=0; d<recognized.size(); d++){
+            if(recognized[d][0].first == labelled.labels[d]) correct++;
+        }
+        report.imageAccuracy = (double)correct / recognized.size();
+    }
+}
+
+string accuracyText(double accuracy){
+    if(accuracy < 0) return "-";
+    stringstream text;
+    text << fixed << setprecision(2) << 100 * accuracy << "%";
+    return text.str();
+}
+
+void printReport(const vector<VariantReport>& reports, size_t nImageDigits, double minAccuracy){
+    cout << left << setw(11) << "variant" << right << setw(7) << "input" << setw(12) << "channels"
+         << setw(11) << "params" << setw(10) << "MFLOPs" << setw(11) << "ms/cell" << setw(12) << "ms 1 cell"
+         << setw(10) << "MNIST" << setw(10) << "images" << endl;
+    for(const VariantReport& report: reports){
+        stringstream channels;
+        vector<int> kept = report.config.keptChannels();
+        for(size_t l=0; l<kept.size(); l++) channels << (l ? "-" : "") << kept[l];
+        if(report.config.separable) channels << "s";
+
+        cout << left << setw(11) << report.config.name << right << setw(7) << report.config.inputSize
+             << setw(12) << channels.str() << setw(11) << report.cost.params
+             << setw(10) << fixed << setprecision(2) << report.cost.flops() / 1e6;
+        if(!report.hasModel){
+            cout << "   no model, train it with --train" << endl;
+            continue;
+        }
+        cout << setw(11) << setprecision(4) << report.msPerCell << setw(12) << report.msSingleCell
+             << setw(10) << accuracyText(report.mnistAccuracy) << setw(10) << accuracyText(report.imageAccuracy) << endl;
+    }
+    cout << "ms/cell: a grid of " << CellReader::nCells << " digits in one batch, "
+         << "images: " << nImageDigits << " digits of images with ground truth" << endl;
+
+    if(minAccuracy <= 0) return;
+    // the cheapest variant whose measured accuracies all reach the bar
+    const VariantReport* best = nullptr;
+    for(const VariantReport& report: reports){
+        bool accurate = report.hasModel && max(report.mnistAccuracy, report.imageAccuracy) >= minAccuracy
+            && (report.mnistAccuracy < 0 || report.mnistAccuracy >= minAccuracy)
+            && (report.imageAccuracy < 0 || report.imageAccuracy >= minAccuracy);
+        if(accurate && (!best || report.cost.macs < best->cost.macs)) best = &report;
+    }
+    if(best) cout << "Smallest variant with " << accuracyText(minAccuracy) << " accuracy: " << best->config.name << endl;
+    else cout << "No variant reaches " << accuracyText(minAccuracy) << " accuracy" << endl;
+}
+
+static int usage(){
+    cout << "Usage: DigitNetReport [--variant NAME]... [--train] [--no-mnist] [--repeat N] [--min-accuracy 0.99] [dir|manifest]" << endl;
+    cout << "Variants:";
+    for(const DigitNetConfig& config: DigitNet::presets()) cout << ' ' << config.name;
+    cout << endl;
+    return -1;
+}
+
+int main(int argc, char *argv[]){
+    string input;
+    vector<string> names;
+    bool train = false;
+    bool mnist = true;
+    int repeat = 20;
+    double minAccuracy = 0;
+    try{
+        for(int a=1; a<argc; a++){
+            string arg = argv[a];
+            if(arg == "--train") train = true;
+            else if(arg == "--no-mnist") mnist = false;
+            else if(arg == "--repeat" && a+1 < argc) repeat = max(1, stoi(argv[++a]));
+            else if(arg == "--min-accuracy" && a+1 < argc) minAccuracy = stod(argv[++a]);
+            else if(arg == "--variant" && a+1 < argc) names.push_back(argv[++a]);
+            else if(arg.compare(0, 2, "--") == 0) return usage();
+            else input = arg;
+        }
+    } catch(exception&){
+        // stoi/stod on a value that is not a number
+        return usage();
+    }
+
+    vector<DigitNetConfig> configs;
+    if(names.empty()) configs = DigitNet::presets();
+    try{
+        for(const string& name: names) configs.push_back(DigitNet::preset(name));
+    } catch(exception&){
+        // preset printed the unknown name
+        return usage();
+    }
+
+    if(train){
+        /**
+         * The baseline is the teacher of all the other variants, so it is trained first unless
+         * its model exists already; the other variants are always trained again.
+         */
+        MnistModel& teacher = MnistModel::getInstance();
+        if(!ifstream(teacher.getModelPath())) teacher.trainModel();
+        TrainOptions options;
+        options.teacher = &teacher;
+        for(const DigitNetConfig& config: configs){
+            if(config.name == teacher.getConfig().name) continue;
+            cout << "Training " << config.name << endl;
+            MnistModel(config).trainModel(options);
+        }
+    }
+
+    LabelledDigits labelled;
+    try{
+        if(!input.empty()) labelled = collectDigits(input);
+    } catch(exception&){
+        return -1;
+    }
+
+    vector<VariantReport> reports(configs.size());
+    for(size_t v=0; v<configs.size(); v++){
+        VariantReport& report = reports[v];
+        report.config = configs[v];
+        report.cost = DigitNet::cost(report.config);
+        report.hasModel = (bool)ifstream(report.config.defaultModelPath());
+        if(!report.hasModel) continue;
+        cerr << "Measuring " << report.config.name << endl;
+        measure(report, labelled, repeat, mnist);
+    }
+    printReport(reports, labelled.images.size(), minAccuracy);
+    return 0;
+}
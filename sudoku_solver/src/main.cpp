@@ -1,4 +1,9 @@
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <omp.h>
 
@@ -9,6 +14,11 @@
 #include "Sudoku.hpp"
 #include "MnistModel.hpp"
 #include "ImgProc.hpp"
+#include "CellReader.hpp"
+#include "BatchPipeline.hpp"
+#include "Pipeline.hpp"
+#include "SolverDaemon.hpp"
+#include "Trace.hpp"
 
 using namespace cv;
 using namespace std;
@@ -40,70 +50,98 @@ void testMnist(){
     m.testLibTorch();
 }
 
-void removeEdges(Mat& img, Mat& binaryImg){
-    binaryImg = img.clone();
-    // flood-fill from the edges
-    for(int i=0;i<img.size().height; i++){
-        if(i == 0 || i == img.size().height-1) {
-            for (int j = 0; j < img.size().width; j++) {
-                floodFill(binaryImg, cv::Point(j, i), Scalar(0));
-            }
-        } else{
-            floodFill(binaryImg, cv::Point(0, i), Scalar(0));
-            floodFill(binaryImg, cv::Point(img.size().width - 1, i), Scalar(0));
+void comparePyramid(const Mat& img, int maxSide){
+    /**
+     * Runs the grid detection once at full resolution and once coarse-to-fine, and reports
+     * how far the grid intersections of the latter are from the full resolution ones.
+     */
+    ImgProcParams fullParams;
+    fullParams.detectionMaxSide = 0;
+    ImgProcParams pyramidParams = fullParams;
+    pyramidParams.detectionMaxSide = maxSide;
+
+    ImgProc full(img, fullParams);
+    ImgProc pyramid(img, pyramidParams);
+    auto start = chrono::steady_clock::now();
+    full.run();
+    auto middle = chrono::steady_clock::now();
+    pyramid.run();
+    auto end = chrono::steady_clock::now();
+
+    double sumDist = 0, maxDist = 0;
+    const vector<Point2f>& reference = full.getGridIntersections();
+    for(auto& p: pyramid.getGridIntersections()){
+        double minDist = 1e9;
+        for(auto& r: reference){
+            minDist = min(minDist, (double)norm(p - r));
         }
+        sumDist += minDist;
+        maxDist = max(maxDist, minDist);
     }
-} 
-
-void centerAndCrop(Mat& img, Mat& centered){
-    Point2i center(0,0);
-    float cnt = 0;
+    Rect fullROI = full.getSudokuROI();
+    Rect pyramidROI = pyramid.getSudokuROI();
+    double iou = (double)(fullROI & pyramidROI).area() / (double)(fullROI | pyramidROI).area();
+
+    cout << "Full resolution: " << chrono::duration<double, milli>(middle - start).count() << " ms" << endl;
+    cout << "Pyramid (max side " << maxSide << "): " << chrono::duration<double, milli>(end - middle).count() << " ms" << endl;
+    cout << "Intersection error: mean " << sumDist / pyramid.getGridIntersections().size()
+         << " px, max " << maxDist << " px" << endl;
+    cout << "ROI IoU: " << iou << endl;
+}
 
-    for(int i=0;i<img.size().width; i++){
-        for(int j=0;j<img.size().height; j++){
-            int val = img.at<uchar>(i, j);
-            if(val> 0){
-                center.x += j;
-                center.y += i;
-                cnt++;
-            }
-        }   
-    }
-    center.x = (float)(center.x) / cnt;
-    center.y = (float)(center.y) / cnt;
-
-    int w = min(min(img.size().width, center.x * 2), (int)((img.size().width - center.x) * 2.0));
-    int h = min(min(img.size().height, center.y * 2), (int)((img.size().height - center.y) * 2.0));
-    Rect centerRect = Rect(center.x-w/2, center.y-h/2, w, h);
-    centered = img(centerRect);
-    //ImgProc::crop(centered, centered, 0.01);
-} 
-
-
-void drawResult(const Mat& img, Mat& drawing, const vector<vector<Rect> >& cells, const Sudoku& digits){
-    cvtColor(img, drawing, COLOR_GRAY2RGB);
-
-    Scalar blue(255, 0, 0);
-    Scalar red(0, 0, 255);
-    Scalar green(0, 255, 0);
-
-    for (int row=0; row<Sudoku::N; row++) { 
-        for (int col=0; col<Sudoku::N; col++){
-            Point2i org(cells[row][col].x + cells[row][col].width * 0.2, cells[row][col].y + cells[row][col].height / 2.0);
-            string digitText = to_string(digits.getValue(row, col));
-            Scalar color;
-            if(digits.getProb(row, col) == UNASSIGNED){
-                color = blue;
-            } else if(digits.getProb(row, col) > MnistModel::acceptanceThreshold){
-                color = green;
-            } else{
-                color = red;
-            }
-            putText(drawing, digitText, org, FONT_HERSHEY_PLAIN, 1, color, 2);
-        }
+void solvePage(const Mat& img, const SolveOptions& options){
+    /**
+     * Multi-grid mode: every puzzle of the page is read and solved, the best solution of each
+     * is drawn into one result image.
+     */
+    auto start = chrono::steady_clock::now();
+    PageResult page = solveImageGrids(img, options);
+    auto end = chrono::steady_clock::now();
+    if(page.isStopped()){
+        cout << "Stopped in " << page.stoppedStage << ": " << Deadline::toString(page.stopReason) << endl;
+    }
+    if(page.grids.empty()){
+        cout << "Failed: " << page.error << endl;
+        return;
+    }
+    cout << page.grids.size() << " grids in " << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+
+    for(size_t g=0; g<page.grids.size(); g++){
+        const SolveResult& result = page.grids[g];
+        cout << "********** Grid " << g << " **********" << endl;
+        cout << "N total games " << result.nCandidates << endl;
+        if(result.isSolved()) result.solutions[0].print();
+        else cout << "Not solved" << endl;
     }
+
+    Mat drawing;
+    drawResults(img, drawing, page);
+    cv::namedWindow("Result", cv::WINDOW_NORMAL | cv::WINDOW_KEEPRATIO | cv::WINDOW_GUI_EXPANDED);
+    cv::imshow("Result", drawing);
+    waitKey(0);
+    destroyAllWindows();
 }
 
+// the daemon that SIGINT and SIGTERM stop, so that it cleans up and prints its report
+static SolverDaemon* runningDaemon = nullptr;
+
+void stopDaemon(int){
+    if(runningDaemon) runningDaemon->stop();
+}
+
+void writeTrace(const string& path){
+    if(path.empty()) return;
+    Trace::printSummary(cout);
+    if(Trace::writeChromeTrace(path)) cout << "Trace written to " << path << endl;
+}
+
+int usage(){
+    cout << "Usage: SudokuSolver [--max-side N] [--solver dfs|cdcl] [--model NAME] [--budget MS] [--debug-dir DIR] [--trace trace.json] [--compare-pyramid] image" << endl;
+    cout << "       SudokuSolver --multi [--max-grids N] [--min-grid FRACTION] [--max-side N] [--solver dfs|cdcl] [--model NAME] [--budget MS] [--trace trace.json] page" << endl;
+    cout << "       SudokuSolver --batch [--out results.jsonl] [--workers N] [--reduce 1|2|4|8] [--solver dfs|cdcl] [--model NAME] [--trace trace.json] dir|manifest" << endl;
+    cout << "       SudokuSolver --daemon SOCKET [--solver dfs|cdcl] [--model NAME] [--budget MS] [--trace trace.json]" << endl;
+    return -1;
+}
 
 int main(int argc, char *argv[]){
     /**
@@ -117,108 +155,172 @@ int main(int argc, char *argv[]){
      *     DONE
      *  4. connect the computer camera for real-time detection
      */
-    if(argc < 2){
-        cout << "Please provide Sudoku image to solve." << endl;
+    string imgPath;
+    bool compare = false;
+    bool batch = false;
+    bool multi = false;
+    string resultsPath = "results.jsonl";
+    string debugDir;
+    string socketPath;
+    string tracePath;
+    ImgProcParams params;
+    BatchOptions batchOptions;
+    string modelName;
+    double budgetMs = 0;
+    string solverName = "dfs";
+    try{
+        for(int a=1; a<argc; a++){
+            string arg = argv[a];
+            if(arg == "--compare-pyramid") compare = true;
+            else if(arg == "--batch") batch = true;
+            else if(arg == "--multi") multi = true;
+            else if(arg == "--max-grids" && a+1 < argc) params.maxGrids = stoi(argv[++a]);
+            else if(arg == "--min-grid" && a+1 < argc) params.minGridFraction = stof(argv[++a]);
+            else if(arg == "--daemon" && a+1 < argc) socketPath = argv[++a];
+            else if(arg == "--max-side" && a+1 < argc) params.detectionMaxSide = stoi(argv[++a]);
+            else if(arg == "--out" && a+1 < argc) resultsPath = argv[++a];
+            else if(arg == "--debug-dir" && a+1 < argc) debugDir = argv[++a];
+            else if(arg == "--trace" && a+1 < argc) tracePath = argv[++a];
+            else if(arg == "--workers" && a+1 < argc) batchOptions.visionWorkers = batchOptions.solverWorkers = stoi(argv[++a]);
+            else if(arg == "--reduce" && a+1 < argc) batchOptions.decodeReduction = stoi(argv[++a]);
+            else if(arg == "--solver" && a+1 < argc) solverName = argv[++a];
+            else if(arg == "--model" && a+1 < argc) modelName = argv[++a];
+            else if(arg == "--budget" && a+1 < argc) budgetMs = stod(argv[++a]);
+            // an unknown option or one without its value is not an image path
+            else if(arg.compare(0, 1, "-") == 0){
+                cout << "Unknown option or missing value: " << arg << endl;
+                return usage();
+            }
+            else imgPath = arg;
+        }
+    } catch(exception&){
+        // stoi/stof/stod on a value that is not a number
+        cout << "Invalid number in the arguments" << endl;
+        return usage();
+    }
+    int reduction = batchOptions.decodeReduction;
+    bool valid = params.maxGrids >= 1 && params.minGridFraction > 0 && params.minGridFraction <= 1
+        && params.detectionMaxSide >= 0 && batchOptions.visionWorkers >= 1 && budgetMs >= 0
+        && (reduction == 1 || reduction == 2 || reduction == 4 || reduction == 8)
+        && (solverName == "dfs" || solverName == "cdcl");
+    if(!valid){
+        cout << "Invalid value in the arguments" << endl;
+        return usage();
+    }
+    Sudoku::Backend solverBackend = solverName == "cdcl" ? Sudoku::CDCL : Sudoku::DFS;
+    // one of the digit-net variants of DigitNet::presets instead of the baseline
+    unique_ptr<MnistModel> variantModel;
+    try{
+        if(!modelName.empty()) variantModel.reset(new MnistModel(DigitNet::preset(modelName)));
+    } catch(exception&){
         return -1;
     }
-    Mat img = imread(argv[1], IMREAD_GRAYSCALE);
-    cout << "Image has size " << img.size() << ", with " << img.channels() << " channels." << endl;
-
-    cout << "Instantiating processor and neural-net..." << endl;
-    ImgProc processor(img);
-    MnistModel& model = MnistModel::getInstance();
-    // model.trainModel();
-
-    cout << "Running image processor...";
-    processor.run();
-    cout << " done." << endl;
-
-    vector<vector<cv::Rect> > sudokuGrid = processor.getSudokuCells();
-
-    vector<Sudoku> possibleGames = vector<Sudoku>();
-    possibleGames.emplace_back();
-
-    cout << "Extracting digits from the Sudoku cells..." << endl;
-    for(int i=0; i<Sudoku::N; i++){
-        for(int j=0; j<Sudoku::N; j++){
-            Rect cellROI = sudokuGrid[i][j];
-            Mat cellImg = img(cellROI);
-
-            Mat digit = ImgProc::invertImg(cellImg);
-//            cv::imshow("digit", digit);
-
-            // work on binary image
-            Mat binaryImg;
-            threshold(digit, binaryImg, mean(digit)[0], 255, THRESH_BINARY);
-//            cv::imshow("binaryImg", binaryImg);
+    // the model is only loaded by the first inference, which may run on a worker thread
+    if(variantModel && !ifstream(variantModel->getModelPath())){
+        cout << "No trained model at " << variantModel->getModelPath() << ", train it with DigitNetReport --train" << endl;
+        return -1;
+    }
+    MnistModel& model = variantModel ? *variantModel : MnistModel::getInstance();
+    if(!tracePath.empty() && !Trace::enabled){
+        cout << "Tracing is compiled out, rebuild with -DSUDOKU_TRACE=ON to use --trace" << endl;
+        tracePath.clear();
+    }
 
-            Mat clean;
-            removeEdges(binaryImg, clean);
-//            cv::namedWindow("no edges", cv::WINDOW_NORMAL | cv::WINDOW_KEEPRATIO | cv::WINDOW_GUI_EXPANDED);
-//            cv::imshow("no edges", clean);
+    if(!socketPath.empty()){
+        SolveOptions options;
+        options.imgProcParams = params;
+        options.solverBackend = solverBackend;
+        options.model = &model;
+        options.budgetMs = budgetMs;
+        SolverDaemon daemon(socketPath, options);
+        daemon.warmUp();
+        runningDaemon = &daemon;
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = stopDaemon;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        daemon.serve();
+        runningDaemon = nullptr;
+        // the requests of the whole session
+        writeTrace(tracePath);
+        return 0;
+    }
+    if(imgPath.empty()){
+        cout << "Please provide Sudoku image to solve." << endl;
+        return usage();
+    }
 
-            double minVal, maxVal; 
-            Point minLoc, maxLoc; 
-            minMaxLoc(clean, &minVal, &maxVal, &minLoc, &maxLoc);
-            if(minVal == maxVal){
-                continue;
-            }
+    // intermediate results of the image processing are written to debugDir in the background
+    unique_ptr<DebugSink> debugSink;
+    if(!debugDir.empty()){
+        debugSink.reset(new DebugSink(debugDir));
+        params.debugSink = debugSink.get();
+    }
 
-//            Mat centered;
-//            centerAndCrop(clean, centered);
-//            cv::namedWindow("centered", cv::WINDOW_NORMAL | cv::WINDOW_KEEPRATIO | cv::WINDOW_GUI_EXPANDED);
-//            cv::imshow("centered", centered);
+    if(batch){
+        batchOptions.imgProcParams = params;
+        batchOptions.solverBackend = solverBackend;
+        BatchPipeline pipeline(batchOptions, model);
+        ofstream results(resultsPath);
+        try{
+            pipeline.run(imgPath, results);
+        } catch(exception&){
+            // the input cannot be listed or there are no workers, the reason is printed already
+            return -1;
+        }
+        cout << "Results written to " << resultsPath << endl;
+        writeTrace(tracePath);
+        return 0;
+    }
+    Mat img;
+    {
+        TRACE_SCOPE("imread");
+        img = imread(imgPath, IMREAD_GRAYSCALE);
+    }
+    if(img.empty()){
+        cout << "Cannot read the image " << imgPath << endl;
+        return -1;
+    }
+    cout << "Image has size " << img.size() << ", with " << img.channels() << " channels." << endl;
 
-            vector<pair<int, float> > recognizedDigits = model.inferClass(clean);
-            // drop zeros since sudoku doesnt have them definitely
-            for(auto it = recognizedDigits.begin(); it != recognizedDigits.end();){
-                if((*it).first == 0) it = recognizedDigits.erase(it); 
-                else it = next(it);
-            }
+    if(compare){
+        comparePyramid(img, params.detectionMaxSide);
+        return 0;
+    }
 
-            if(recognizedDigits[0].second >= MnistModel::acceptanceThreshold){
-                cout << "Definitive digit: " << recognizedDigits[0].first << " with prob: " << recognizedDigits[0].second << endl;
-                for(auto & possibleGame : possibleGames){
-                    possibleGame.fill(i, j, recognizedDigits[0].first, recognizedDigits[0].second);
-                }
-            } else{
-                cout << "Possible digits: " << recognizedDigits[0] << " and " << recognizedDigits[1] << " and " << recognizedDigits[2] << endl;
-                vector<Sudoku> newPossibleGames = vector<Sudoku>();
-                for(auto & possibleGame : possibleGames){
-                    for(size_t p=1; p<recognizedDigits.size(); p++){
-                        Sudoku newGame(possibleGame);
-                        newGame.fill(i, j, recognizedDigits[p].first, recognizedDigits[p].second);
-                        newPossibleGames.emplace_back(move(newGame));
-                    }
-                    possibleGame.fill(i, j, recognizedDigits[0].first, recognizedDigits[0].second);
-                }
-                // concat vectors without copy
-                possibleGames.insert(
-                        possibleGames.end(),
-                        make_move_iterator(newPossibleGames.begin()),
-                        make_move_iterator(newPossibleGames.end()));
+    // model.trainModel();
 
-            }
-            //waitKey(0);
-        }
+    cout << "Solving..." << endl;
+    SolveOptions options;
+    options.imgProcParams = params;
+    options.model = &model;
+    options.solverBackend = solverBackend;
+    options.budgetMs = budgetMs;
+    if(multi){
+        solvePage(img, options);
+        writeTrace(tracePath);
+        return 0;
     }
-    cout << "N total games " <<  possibleGames.size() << endl;
-    //destroyAllWindows();
-
-    #pragma omp parallel for num_threads(2)
-    for(size_t i=0; i<possibleGames.size(); i++){
-        if(possibleGames[i].isValid())
-            possibleGames[i].solve();
+    SolveResult result = solveImage(img, options);
+    if(result.isStopped()){
+        cout << "Stopped in " << result.stoppedStage << ": " << Deadline::toString(result.stopReason) << endl;
     }
+    if(!result.gridFound){
+        cout << "Failed: " << result.error << endl;
+        return -1;
+    }
+    CellReader::print(result.cells);
+    cout << "N total games " <<  result.nCandidates << endl;
+    writeTrace(tracePath);
 
     cout << "********** Solved Games **********" << endl;
-    for(size_t i=0; i<possibleGames.size(); i++){
-        if(!possibleGames[i].isSolved()) continue;
-        possibleGames[i].print();
-        cout << endl;
+    for(size_t i=0; i<result.solutions.size(); i++){
+        result.solutions[i].print();
+        cout << "(" << result.solutions[i].getIterations() << " iterations, " << result.solutions[i].getConflicts() << " conflicts)" << endl << endl;
 
         Mat drawing;
-        drawResult(img, drawing, sudokuGrid, possibleGames[i]);
+        drawResult(img, drawing, result.cellRects, result.solutions[i]);
 
         stringstream title;
         title << "Result " << i;
@@ -228,5 +330,4 @@ int main(int argc, char *argv[]){
 
     waitKey(0);
     destroyAllWindows();    
-}
-
+}
\ No newline at end of file
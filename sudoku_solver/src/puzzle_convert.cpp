@@ -0,0 +1,196 @@
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "PuzzleFile.hpp"
+#include "Sudoku.hpp"
+
+using namespace std;
+
+/**
+ * Converts puzzle corpora between the usual text format and the packed binary one (PuzzleFile.hpp),
+ * and measures how fast either format loads. A text line starts with the 81-character puzzle
+ * ('.' or '0' for empty cells), optionally followed by the solution and by a difficulty, separated
+ * by spaces, commas, semicolons or tabs.
+ */
+
+struct TextRecord{
+    int givens[PuzzleFile::nCells];
+    int solution[PuzzleFile::nCells];
+    bool hasSolution = false;
+    bool hasDifficulty = false;
+    uint32_t difficulty = 0;
+};
+
+bool parseLine(const string& line, TextRecord& record){
+    if(!PuzzleFile::parseText(line, record.givens)) return false;
+    record.hasSolution = record.hasDifficulty = false;
+    record.difficulty = 0;
+    size_t pos = PuzzleFile::nCells;
+    while(pos < line.size()){
+        size_t start = line.find_first_not_of(" ,;\t\r", pos);
+        if(start == string::npos) break;
+        size_t end = line.find_first_of(" ,;\t\r", start);
+        if(end == string::npos) end = line.size();
+        if(end - start == (size_t)PuzzleFile::nCells){
+            record.hasSolution = PuzzleFile::parseText(line, record.solution, start);
+        }
+        else if(isdigit(line[start])){
+            record.difficulty = (uint32_t)stoul(line.substr(start, end - start));
+            record.hasDifficulty = true;
+        }
+        pos = end;
+    }
+    return true;
+}
+
+int textToBinary(const string& inPath, const string& outPath, bool solve){
+    ifstream in(inPath);
+    if(!in){
+        cout << "Cannot read " << inPath << endl;
+        return -1;
+    }
+    string line;
+    TextRecord record;
+    // the columns of the first puzzle decide which fields the file has
+    uint16_t flags = 0;
+    streampos firstLine = in.tellg();
+    while(getline(in, line)){
+        if(!parseLine(line, record)) continue;
+        flags = (record.hasSolution ? PuzzleFile::HAS_SOLUTION : 0) | (record.hasDifficulty ? PuzzleFile::HAS_DIFFICULTY : 0);
+        break;
+    }
+    if(solve) flags |= PuzzleFile::HAS_SOLUTION | PuzzleFile::HAS_DIFFICULTY;
+    in.clear();
+    in.seekg(firstLine);
+
+    PuzzleFileWriter writer(outPath, flags);
+    Sudoku game;
+    game.setBackend(Sudoku::CDCL);
+    size_t nUnsolvable = 0;
+    while(getline(in, line)){
+        if(!parseLine(line, record)) continue;
+        if(solve && !record.hasSolution){
+            // the conflicts of the CDCL backend are the difficulty unless the line has one
+            game.reset(record.givens);
+            if(game.isValid() && game.solve()){
+                for(int cell = 0; cell < PuzzleFile::nCells; cell++)
+                    record.solution[cell] = game.getValue(cell / Sudoku::N, cell % Sudoku::N);
+                record.hasSolution = true;
+                if(!record.hasDifficulty) record.difficulty = game.getConflicts();
+            }
+            else nUnsolvable++;
+        }
+        writer.write(record.givens, record.hasSolution ? record.solution : nullptr, record.difficulty);
+    }
+    // throws if the file could not be written, main reports the failure
+    writer.close();
+    cout << "Wrote " << writer.size() << " puzzles to " << outPath;
+    if(solve) cout << ", " << nUnsolvable << " without a solution";
+    cout << endl;
+    return 0;
+}
+
+int binaryToText(const string& inPath, const string& outPath){
+    PuzzleFileReader reader(inPath);
+    ofstream out(outPath);
+    int values[PuzzleFile::nCells];
+    size_t nCorrupt = 0;
+    for(size_t i=0; i<reader.size(); i++){
+        // corrupt cells are written as empty
+        nCorrupt += !reader.getGivens(i, values);
+        out << PuzzleFile::toText(values);
+        if(reader.getSolution(i, values)) out << ' ' << PuzzleFile::toText(values);
+        if(reader.hasDifficulty()) out << ' ' << reader.getDifficulty(i);
+        out << '\n';
+    }
+    out.close();
+    if(!out){
+        cout << "Cannot write " << outPath << endl;
+        return -1;
+    }
+    cout << "Wrote " << reader.size() << " puzzles to " << outPath << endl;
+    if(nCorrupt) cout << nCorrupt << " of them are corrupt, their invalid cells were written as empty" << endl;
+    return nCorrupt ? -1 : 0;
+}
+
+int benchmark(const string& binaryPath, const string& textPath){
+    /**
+     * Loads every puzzle into the same Sudoku, which is what a consumer of the corpus does;
+     * the unpacking alone is timed as well. The first pass pages the file in.
+     */
+    PuzzleFileReader reader(binaryPath);
+    int values[PuzzleFile::nCells];
+    long checksum = 0;
+    for(size_t i=0; i<reader.size(); i++){
+        reader.getGivens(i, values);
+        checksum += values[i % PuzzleFile::nCells];
+    }
+
+    auto start = chrono::steady_clock::now();
+    for(size_t i=0; i<reader.size(); i++){
+        reader.getGivens(i, values);
+        checksum += values[i % PuzzleFile::nCells];
+    }
+    double unpackSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    Sudoku game;
+    start = chrono::steady_clock::now();
+    for(size_t i=0; i<reader.size(); i++){
+        reader.read(i, game);
+        checksum += game.getValue(4, 4);
+    }
+    double binarySeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    size_t recordBytes = reader.size() * reader.getRecordSize();
+    cout << reader.size() << " puzzles (checksum " << checksum << ")" << endl;
+    cout << "    binary, unpack only: " << unpackSeconds * 1e3 << " ms, " << reader.size() / unpackSeconds / 1e6
+         << " M puzzles/s, " << recordBytes / unpackSeconds / 1e9 << " GB/s" << endl;
+    cout << "    binary into Sudoku:  " << binarySeconds * 1e3 << " ms, " << reader.size() / binarySeconds / 1e6
+         << " M puzzles/s" << endl;
+
+    if(textPath.empty()) return 0;
+    ifstream text(textPath);
+    string line;
+    size_t nText = 0;
+    start = chrono::steady_clock::now();
+    while(getline(text, line)){
+        if(!PuzzleFile::parseText(line, values)) continue;
+        game.reset(values);
+        checksum += game.getValue(4, 4);
+        nText++;
+    }
+    double textSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "    text into Sudoku:    " << textSeconds * 1e3 << " ms, " << nText / textSeconds / 1e6
+         << " M puzzles/s" << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]){
+    bool solve = false, toText = false, bench = false;
+    vector<string> paths;
+    for(int a=1; a<argc; a++){
+        string arg = argv[a];
+        if(arg == "--solve") solve = true;
+        else if(arg == "--to-text") toText = true;
+        else if(arg == "--bench") bench = true;
+        else paths.push_back(arg);
+    }
+    if(!(bench && !paths.empty()) && paths.size() != 2){
+        cout << "Usage: PuzzleConvert [--solve] puzzles.txt puzzles.sdkp" << endl;
+        cout << "       PuzzleConvert --to-text puzzles.sdkp puzzles.txt" << endl;
+        cout << "       PuzzleConvert --bench puzzles.sdkp [puzzles.txt]" << endl;
+        return -1;
+    }
+    // files that cannot be opened or are not puzzle files, the reason is printed already
+    try{
+        if(bench) return benchmark(paths[0], paths.size() > 1 ? paths[1] : "");
+        return toText ? binaryToText(paths[0], paths[1]) : textToBinary(paths[0], paths[1], solve);
+    } catch(exception&){
+        return -1;
+    }
+}
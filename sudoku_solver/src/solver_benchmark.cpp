@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "PuzzleFile.hpp"
+#include "Sudoku.hpp"
+#include "SudokuRules.hpp"
+
+using namespace std;
+
+/**
+ * Solver benchmark, no OpenCV or LibTorch needed. Classic puzzles are solved by the unit table
+ * engine and by the previous hard-coded row/column/box scan (kept below for reference only),
+ * which visit the same cells in the same order, so the iterations have to match and only the
+ * time per iteration differs. Generated X, jigsaw and killer puzzles show the variants.
+ *
+ * Every puzzle is solved by the CDCL backend as well, together with a few puzzles that are
+ * pathological for the depth-first search.
+ *
+ * Finally Sudoku::resolve is timed against a fresh solve after 1 to 16 givens changed.
+ */
+
+struct Puzzle{
+    string label;
+    vector<vector<int> > grid;
+    shared_ptr<const SudokuRules> rules;
+};
+
+// the solver before the unit table, with its rules hard-coded
+struct LegacySolver{
+    long iterations = 0;
+
+    static bool isValidEntry(const vector<vector<int> >& grid, int row, int col, int value){
+        for(int c=0; c<Sudoku::N; c++)
+            if(c != col && grid[row][c] == value)
+                return false;
+        for(int r=0; r<Sudoku::N; r++)
+            if(r != row && grid[r][col] == value)
+                return false;
+        for(int r=row/3*3; r<row/3*3+3; r++)
+            for(int c=col/3*3; c<col/3*3+3; c++)
+                if((r != row && c != col) && grid[r][c] == value)
+                    return false;
+        return true;
+    }
+
+    bool solve(vector<vector<int> >& grid){
+        iterations++;
+        int row = 0, col = 0;
+        bool found = false;
+        for(row=0; row<Sudoku::N && !found; row++)
+            for(col=0; col<Sudoku::N && !found; col++)
+                found = grid[row][col] == UNASSIGNED;
+        if(!found) return true;
+        row--; col--;
+        for(int value=1; value<10; value++){
+            if(isValidEntry(grid, row, col, value)){
+                grid[row][col] = value;
+                if(solve(grid)) return true;
+                grid[row][col] = UNASSIGNED;
+            }
+        }
+        return false;
+    }
+};
+
+vector<vector<int> > parseGrid(const string& line){
+    vector<vector<int> > grid(Sudoku::N, vector<int>(Sudoku::N, UNASSIGNED));
+    for(int k=0; k<Sudoku::N * Sudoku::N; k++){
+        char c = line[k];
+        if(c >= '1' && c <= '9') grid[k / Sudoku::N][k % Sudoku::N] = c - '0';
+    }
+    return grid;
+}
+
+vector<Puzzle> classicPuzzles(const string& path){
+    vector<string> lines = {
+        // data/sudoku10.txt, data/sudoku11.txt, data/sudoku2.txt
+        "9.......1...234......1.5....74...23..6.....4..89...57....4.8......567...2.......7",
+        ".5..6..8.6..8.2..5...1.5....91...87.8.......9.27...61....6.8...3..2.9..4.7..1..2.",
+        "25..3.9.1.1...4...4.7...2.8..52.........981...4...3......36..72.7......39.3...6.4",
+        // hard for depth-first search
+        "8..........36......7..9.2...5...7.......457.....1...3...1....68..85...1..9....4..",
+        "52...6.........7.13...........4..8..6......5...........418.........3..2...87.....",
+    };
+    if(path.size() > 5 && path.substr(path.size() - 5) == ".sdkp"){
+        PuzzleFileReader reader(path);
+        lines.clear();
+        int values[PuzzleFile::nCells];
+        for(size_t i=0; i<reader.size(); i++){
+            if(reader.getGivens(i, values)) lines.push_back(PuzzleFile::toText(values));
+            else cout << "Skipping corrupt puzzle " << i << " of " << path << endl;
+        }
+    }
+    else if(!path.empty()){
+        lines.clear();
+        ifstream file(path);
+        string line;
+        while(getline(file, line)){
+            if(line.size() >= 81) lines.push_back(line.substr(0, 81));
+        }
+    }
+    vector<Puzzle> puzzles;
+    for(auto& line: lines) puzzles.push_back({line.substr(0, 20) + "...", parseGrid(line), SudokuRules::classic()});
+    return puzzles;
+}
+
+// 17-clue and anti-DFS puzzles, millions of iterations for the depth-first search
+vector<Puzzle> pathologicalPuzzles(){
+    vector<string> lines = {
+        "..............3.85..1.2.......5.7.....4...1...9.......5......73..2.1........4...9",
+        "4.....8.5.3..........7......2.....6.....8.4......1.......6.3.7.5..2.....1.4......",
+        "6.....8.3.4.7.................5.4.7.3..2.....1.6.......2.....5.....8.6......1....",
+        "....14....3....2...7..........9...3.6.1.............8.2.....1.4....5.6.....7.8...",
+    };
+    vector<Puzzle> puzzles;
+    for(auto& line: lines) puzzles.push_back({line.substr(0, 20) + "...", parseGrid(line), SudokuRules::classic()});
+    return puzzles;
+}
+
+struct Timing{
+    double bestMs = 1e30;
+    bool solved = false;
+    int iterations = 0;
+    int conflicts = 0;
+    vector<vector<int> > solution;
+};
+
+// best of repeat runs, but stops repeating after a second
+Timing timeSolver(Puzzle& puzzle, Sudoku::Backend backend, int repeat){
+    Timing timing;
+    double totalMs = 0;
+    for(int r=0; r<repeat && totalMs < 1000; r++){
+        Sudoku game(puzzle.grid, puzzle.rules);
+        game.setBackend(backend);
+        auto start = chrono::steady_clock::now();
+        timing.solved = game.solve();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        timing.bestMs = min(timing.bestMs, ms);
+        totalMs += ms;
+        timing.iterations = game.getIterations();
+        timing.conflicts = game.getConflicts();
+        timing.solution.assign(Sudoku::N, vector<int>(Sudoku::N));
+        for(int row=0; row<Sudoku::N; row++)
+            for(int col=0; col<Sudoku::N; col++)
+                timing.solution[row][col] = game.getValue(row, col);
+    }
+    return timing;
+}
+
+// a full grid that satisfies the rules, found by solving the empty grid
+vector<vector<int> > solutionOf(shared_ptr<const SudokuRules> rules){
+    vector<vector<int> > empty(Sudoku::N, vector<int>(Sudoku::N, UNASSIGNED));
+    Sudoku game(empty, rules);
+    if(!game.solve()){
+        cout << "The rules do not allow any solution" << endl;
+        throw exception();
+    }
+    vector<vector<int> > solution(Sudoku::N, vector<int>(Sudoku::N));
+    for(int row=0; row<Sudoku::N; row++)
+        for(int col=0; col<Sudoku::N; col++)
+            solution[row][col] = game.getValue(row, col);
+    return solution;
+}
+
+// keeps nGivens random cells of solution
+vector<vector<int> > withGivens(const vector<vector<int> >& solution, int nGivens, mt19937& rng){
+    vector<int> cells(SudokuRules::nCells);
+    for(int k=0; k<SudokuRules::nCells; k++) cells[k] = k;
+    shuffle(cells.begin(), cells.end(), rng);
+    vector<vector<int> > grid(Sudoku::N, vector<int>(Sudoku::N, UNASSIGNED));
+    for(int i=0; i<nGivens; i++) grid[cells[i] / Sudoku::N][cells[i] % Sudoku::N] = solution[cells[i] / Sudoku::N][cells[i] % Sudoku::N];
+    return grid;
+}
+
+// relabels the digits of a classic solution, so that each puzzle has a different one
+vector<vector<int> > permuteDigits(vector<vector<int> > grid, mt19937& rng){
+    vector<int> digits = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    shuffle(digits.begin(), digits.end(), rng);
+    for(auto& row: grid)
+        for(auto& value: row)
+            value = digits[value - 1];
+    return grid;
+}
+
+vector<Puzzle> variantPuzzles(int nEach){
+    vector<Puzzle> puzzles;
+    mt19937 rng(42);
+
+    auto xRules = make_shared<SudokuRules>();
+    xRules->addDiagonals();
+    vector<vector<int> > xSolution = solutionOf(xRules);
+    for(int i=0; i<nEach; i++) puzzles.push_back({"X-sudoku " + to_string(i), withGivens(xSolution, 26, rng), xRules});
+
+    // the 3x3 boxes with a few cells swapped between neighbouring ones
+    const string layout =
+        "000111222"
+        "000111222"
+        "003111222"
+        "033444555"
+        "333444555"
+        "333744555"
+        "666747888"
+        "666777888"
+        "666777888";
+    vector<int> regions;
+    for(char c: layout) regions.push_back(c - '0');
+    auto jigsawRules = make_shared<SudokuRules>();
+    jigsawRules->setRegions(regions);
+    vector<vector<int> > jigsawSolution = solutionOf(jigsawRules);
+    for(int i=0; i<nEach; i++) puzzles.push_back({"jigsaw " + to_string(i), withGivens(jigsawSolution, 28, rng), jigsawRules});
+
+    // cages of 1 to 4 neighbouring cells grown over a classic solution
+    vector<vector<int> > classicSolution = solutionOf(SudokuRules::classic());
+    for(int i=0; i<nEach; i++){
+        vector<vector<int> > solution = permuteDigits(classicSolution, rng);
+        auto killerRules = make_shared<SudokuRules>();
+        vector<char> caged(SudokuRules::nCells, 0);
+        for(int start=0; start<SudokuRules::nCells; start++){
+            if(caged[start]) continue;
+            vector<int> cage = {start};
+            int usedDigits = 1 << (solution[start / Sudoku::N][start % Sudoku::N] - 1);
+            caged[start] = 1;
+            int size = uniform_int_distribution<int>(1, 4)(rng);
+            for(int grow=1; grow<size; grow++){
+                int last = cage.back();
+                int candidates[2] = {last + 1, last + Sudoku::N};
+                int next = -1;
+                for(int cell: candidates){
+                    if(cell >= SudokuRules::nCells || caged[cell] || (cell == last + 1 && cell % Sudoku::N == 0)) continue;
+                    int bit = 1 << (solution[cell / Sudoku::N][cell % Sudoku::N] - 1);
+                    if(!(usedDigits & bit)){
+                        next = cell;
+                        break;
+                    }
+                }
+                if(next < 0) break;
+                cage.push_back(next);
+                caged[next] = 1;
+                usedDigits |= 1 << (solution[next / Sudoku::N][next % Sudoku::N] - 1);
+            }
+            int sum = 0;
+            for(int cell: cage) sum += solution[cell / Sudoku::N][cell % Sudoku::N];
+            killerRules->addCage(cage, sum);
+        }
+        puzzles.push_back({"killer " + to_string(i), withGivens(solution, 8, rng), killerRules});
+    }
+    return puzzles;
+}
+
+double median(vector<double> values){
+    if(values.empty()) return 0;
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// nChanges random edits of the givens of a solved puzzle. Frames: a digit of the solution appears
+// (recognized in a new frame), a given disappears, or an empty cell gets another digit. Corrections:
+// empty cells get a digit other than the solution's that no given peer has, so the previous
+// solution never holds and resolve() has to search again
+vector<Sudoku::CellChange> randomChanges(const Puzzle& puzzle, const Sudoku& solved, int nChanges, bool corrections,
+                                         mt19937& rng){
+    vector<int> cells(SudokuRules::nCells);
+    for(int k=0; k<SudokuRules::nCells; k++) cells[k] = k;
+    shuffle(cells.begin(), cells.end(), rng);
+    vector<vector<int> > givens = puzzle.grid;
+    vector<Sudoku::CellChange> changes;
+    for(int i=0; i<SudokuRules::nCells && (int)changes.size() < nChanges; i++){
+        int row = cells[i] / Sudoku::N, col = cells[i] % Sudoku::N;
+        int solution = solved.getValue(row, col);
+        int value = solution;
+        if(corrections){
+            if(givens[row][col] != UNASSIGNED) continue;
+            int allowed = SudokuRules::allDigits & ~(1 << (solution - 1));
+            for(int peer: puzzle.rules->getPeers(cells[i])){
+                int given = givens[peer / Sudoku::N][peer % Sudoku::N];
+                if(given != UNASSIGNED) allowed &= ~(1 << (given - 1));
+            }
+            if(!allowed) continue;
+            vector<int> digits;
+            for(int d=1; d<=Sudoku::N; d++)
+                if(allowed & (1 << (d - 1))) digits.push_back(d);
+            value = digits[rng() % digits.size()];
+        }
+        else if(givens[row][col] != UNASSIGNED) value = UNASSIGNED;
+        else if(rng() % 4 == 0) value = (solution + (int)(rng() % (Sudoku::N - 1))) % Sudoku::N + 1;
+        givens[row][col] = value;
+        changes.push_back({row, col, value, 1.0});
+    }
+    return changes;
+}
+
+void benchmarkResolve(const vector<Puzzle>& puzzles, int repeat){
+    cout << "Incremental re-solve vs. full solve (median of " << repeat << " random diffs per puzzle)" << endl;
+    static const char* pathNames[] = {"reused", "local", "full", "unsolvable"};
+    mt19937 rng(7);
+    for(bool corrections: {false, true}){
+        cout << "  " << (corrections ? "corrections (digits that contradict the previous solution)" : "frames (digits appear, disappear or change)") << endl;
+        for(int nChanges: {1, 2, 4, 8, 16}){
+            // by how resolve() got its answer, the last one for changed puzzles without a solution;
+            // the fresh solves of the same diffs next to them
+            vector<double> resolveMs[4], freshMs[4];
+            int nMismatches = 0;
+            for(auto& puzzle: puzzles){
+                vector<vector<int> > grid = puzzle.grid;
+                Sudoku solved(grid, puzzle.rules);
+                if(!solved.solve()) continue;
+                for(int r=0; r<repeat; r++){
+                    vector<Sudoku::CellChange> changes = randomChanges(puzzle, solved, nChanges, corrections, rng);
+                    vector<vector<int> > changedGrid = puzzle.grid;
+                    for(auto& change: changes) changedGrid[change.row][change.col] = change.value;
+
+                    Sudoku incremental(solved);
+                    auto start = chrono::steady_clock::now();
+                    bool resolved = incremental.resolve(changes);
+                    int path = resolved ? incremental.getLastResolve() : 3;
+                    resolveMs[path].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+                    // what the pipeline did before: validate and solve the changed puzzle from scratch
+                    Sudoku fresh(changedGrid, puzzle.rules);
+                    start = chrono::steady_clock::now();
+                    bool full = fresh.isValid() && fresh.solve();
+                    freshMs[path].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+
+                    // several solutions are possible, but both have to agree on whether there is one and
+                    // the re-solved grid has to keep the givens
+                    bool keepsGivens = true;
+                    for(int row=0; row<Sudoku::N; row++)
+                        for(int col=0; col<Sudoku::N; col++)
+                            keepsGivens = keepsGivens && (changedGrid[row][col] == UNASSIGNED || changedGrid[row][col] == incremental.getValue(row, col));
+                    if(resolved != full || (resolved && !(keepsGivens && incremental.isValid()))) nMismatches++;
+                }
+            }
+            cout << "    " << nChanges << " changed:";
+            for(int path=0; path<4; path++){
+                cout << (path ? " |" : "") << " " << resolveMs[path].size() << " " << pathNames[path];
+                if(resolveMs[path].empty()) continue;
+                cout << " " << median(resolveMs[path]) * 1000 << " us (fresh " << median(freshMs[path]) * 1000 << " us)";
+            }
+            cout << (nMismatches ? " (" + to_string(nMismatches) + " MISMATCHES)" : "") << endl;
+        }
+    }
+}
+
+int main(int argc, char *argv[]){
+    int repeat = 20;
+    int nVariants = 5;
+    string puzzlesPath;
+    for(int a=1; a<argc; a++){
+        string arg = argv[a];
+        if(arg == "--repeat" && a+1 < argc) repeat = max(1, stoi(argv[++a]));
+        else if(arg == "--variants" && a+1 < argc) nVariants = stoi(argv[++a]);
+        else if(arg.empty() || arg[0] == '-'){
+            cout << "Usage: SolverBenchmark [--repeat N] [--variants N] [puzzles.txt|puzzles.sdkp]" << endl;
+            return -1;
+        }
+        else puzzlesPath = arg;
+    }
+    // the puzzle file cannot be opened or is not a puzzle file, the reason is printed already
+    try{
+        if(classicPuzzles(puzzlesPath).empty()){
+            cout << "No puzzles in " << puzzlesPath << endl;
+            return -1;
+        }
+    } catch(exception&){
+        return -1;
+    }
+
+    cout << "Classic puzzles, unit table vs. hard-coded rules (best of " << repeat << ")" << endl;
+    double totalLegacy = 0, totalUnits = 0;
+    for(auto& puzzle: classicPuzzles(puzzlesPath)){
+        double bestLegacy = 1e30, bestUnits = 1e30;
+        long legacyIterations = 0;
+        int unitIterations = 0;
+        bool sameSolution = true;
+        for(int r=0; r<repeat; r++){
+            vector<vector<int> > legacyGrid = puzzle.grid;
+            LegacySolver legacy;
+            auto start = chrono::steady_clock::now();
+            legacy.solve(legacyGrid);
+            bestLegacy = min(bestLegacy, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            legacyIterations = legacy.iterations;
+
+            Sudoku game(puzzle.grid, puzzle.rules);
+            start = chrono::steady_clock::now();
+            game.solve();
+            bestUnits = min(bestUnits, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            unitIterations = game.getIterations();
+            for(int row=0; row<Sudoku::N; row++)
+                for(int col=0; col<Sudoku::N; col++)
+                    sameSolution = sameSolution && game.getValue(row, col) == legacyGrid[row][col];
+        }
+        totalLegacy += bestLegacy;
+        totalUnits += bestUnits;
+        cout << "    " << puzzle.label << ": hard-coded " << bestLegacy << " ms, units " << bestUnits << " ms, "
+             << unitIterations << " iterations" << (legacyIterations == unitIterations && sameSolution ? "" : " (MISMATCH)") << endl;
+    }
+    cout << "    total: hard-coded " << totalLegacy << " ms, units " << totalUnits << " ms, speedup "
+         << (totalUnits > 0 ? totalLegacy / totalUnits : 0) << "x" << endl;
+
+    cout << "Depth-first search vs. CDCL (best of up to " << repeat << ")" << endl;
+    vector<Puzzle> puzzles = classicPuzzles(puzzlesPath);
+    for(auto& puzzle: pathologicalPuzzles()) puzzles.push_back(puzzle);
+    if(nVariants > 0){
+        for(auto& puzzle: variantPuzzles(nVariants)) puzzles.push_back(puzzle);
+    }
+    double worstDfs = 0, worstCdcl = 0;
+    for(auto& puzzle: puzzles){
+        Timing dfs = timeSolver(puzzle, Sudoku::DFS, repeat);
+        Timing cdcl = timeSolver(puzzle, Sudoku::CDCL, repeat);
+        worstDfs = max(worstDfs, dfs.bestMs);
+        worstCdcl = max(worstCdcl, cdcl.bestMs);
+        // generated variants have several solutions, the backends may find different ones
+        bool same = dfs.solved == cdcl.solved && (!dfs.solved || dfs.solution == cdcl.solution);
+        cout << "    " << puzzle.label << ": DFS " << dfs.bestMs << " ms, " << dfs.iterations << " iterations, "
+             << dfs.conflicts << " dead ends | CDCL " << cdcl.bestMs << " ms, " << cdcl.iterations << " decisions, "
+             << cdcl.conflicts << " conflicts" << (cdcl.solved ? "" : " (NOT SOLVED)") << (same ? "" : " (another solution)") << endl;
+    }
+    cout << "    worst: DFS " << worstDfs << " ms, CDCL " << worstCdcl << " ms" << endl;
+
+    // the classic puzzles have one solution, so most digits that do not match it make them
+    // unsolvable; the generated ones with few givens have many and exercise the local search
+    // (with fewer givens an unsolvable diff can take the depth-first search seconds)
+    vector<Puzzle> resolvePuzzles = classicPuzzles(puzzlesPath);
+    mt19937 rng(11);
+    vector<vector<int> > classicSolution = solutionOf(SudokuRules::classic());
+    for(int i=0; i<10; i++){
+        resolvePuzzles.push_back({"generated " + to_string(i), withGivens(permuteDigits(classicSolution, rng), 30, rng),
+                                  SudokuRules::classic()});
+    }
+    benchmarkResolve(resolvePuzzles, repeat);
+    return 0;
+}